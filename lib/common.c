@@ -109,3 +109,39 @@ void error (char *str)
 {
   printf ("%s\n", str);
 }
+
+/* Final mixing step of MurmurHash3, which makes every input bit
+ * affect every output bit. */
+static uint64_t fmix64 (uint64_t h)
+{
+  h ^= h >> 33;
+  h *= 0xff51afd7ed558ccdULL;
+  h ^= h >> 33;
+  h *= 0xc4ceb9fe1a85ec53ULL;
+  h ^= h >> 33;
+  return h;
+}
+
+uint32_t word_hash (uint64_t w)
+{
+  return (uint32_t) fmix64 (w);
+}
+
+uint32_t mem_hash (const void *key, size_t len)
+{
+  const unsigned char *p = key;
+  uint64_t h = 0x9e3779b97f4a7c15ULL ^ len, w;
+  for (; len >= 8; len -= 8, p += 8)
+    {
+      memcpy (&w, p, 8);
+      h ^= w * 0x87c37b91114253d5ULL;
+      h = ((h << 31) | (h >> 33)) * 0x4cf5ad432745937fULL;
+    }
+  if (len > 0)
+    {
+      w = 0;
+      memcpy (&w, p, len);
+      h ^= w * 0x87c37b91114253d5ULL;
+    }
+  return (uint32_t) fmix64 (h);
+}
@@ -3,6 +3,7 @@
 #define COMMON_H
 
 #include <stdlib.h>
+#include <stdint.h>
 
 /* Wrapper for malloc() and realloc(). Will exit() the program on error. */
 void *xmalloc (size_t size);
@@ -23,4 +24,13 @@ char *unprocess_str (char *str);
 
 void error (char *str);
 
+/* Hash a block of memory, a word at a time. */
+uint32_t mem_hash (const void *key, size_t len);
+
+/* Hash a single integer, such as a pointer. */
+uint32_t word_hash (uint64_t w);
+
+/* Mix hash x into h, so that the order of combining matters. */
+#define hash_combine(h, x) word_hash (((uint64_t) (h) << 32) | (x))
+
 #endif /* COMMON_H */
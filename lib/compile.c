@@ -0,0 +1,1053 @@
+/* compile.c - compile lambda bodies to bytecode
+ *
+ * Bodies are compiled the first time the function is called. The code
+ * is found through an index stored in the header of the cons holding
+ * the function's parameter list and body, which is shared by every
+ * function made from the same lambda form.
+ *
+ * Special forms, macros and a few builtins are compiled to their own
+ * instructions, guarded by a check that the head symbol still holds
+ * the value it had at compile time. When a guard fails the original
+ * form is handed to the tree walker, as is anything the compiler
+ * doesn't understand.
+ *
+ * Closures are compiled as lexical code. Their parameters and let
+ * variables live in locals of the activation, unless a nested function
+ * uses them, in which case they move to a heap frame the function's
+ * closure keeps. Which ones that is isn't known until the nested
+ * functions are compiled, so a function with captured variables is
+ * compiled a second time. */
+#include "common.h"
+#include "object.h"
+#include "cons.h"
+#include "symtab.h"
+#include "eval.h"
+#include "vm.h"
+
+/* Values the compiler knows how to open-code. */
+static object_t *sp_if, *sp_cond, *sp_while, *sp_let, *sp_progn,
+  *sp_quote, *sp_and, *sp_or, *sp_catch, *sp_lambda, *sp_defun, *cf_set;
+
+static char *prim_names[] = {
+  "+", "-", "*", "/", "%", "=", "<", "<=", ">", ">=",
+  "car", "cdr", "cons", "eq", "eql", "not", "nullp", "listp",
+  "symbolp", "stringp", "numberp", "integerp", "floatp", "vectorp",
+  "vget", "vset", "vlength", NULL
+};
+static object_t **prims;
+
+/* Limits on macro expansion while compiling one body. */
+#define MAX_EXPANSIONS 1024
+#define MAX_NESTING 256
+
+void vm_init ()
+{
+  sp_if = GET (c_sym ("if"));
+  sp_cond = GET (c_sym ("cond"));
+  sp_while = GET (c_sym ("while"));
+  sp_let = GET (c_sym ("let"));
+  sp_progn = GET (c_sym ("progn"));
+  sp_quote = GET (c_sym ("quote"));
+  sp_and = GET (c_sym ("and"));
+  sp_or = GET (c_sym ("or"));
+  sp_catch = GET (c_sym ("catch"));
+  sp_lambda = GET (lambda);
+  sp_defun = GET (c_sym ("defun"));
+  cf_set = GET (sym_set);
+
+  size_t n = 0;
+  while (prim_names[n] != NULL)
+    n++;
+  prims = xmalloc ((n + 1) * sizeof (object_t *));
+  for (n = 0; prim_names[n] != NULL; n++)
+    prims[n] = GET (c_sym (prim_names[n]));
+  prims[n] = NULL;
+}
+
+/* Code table, indexed by the code field of the key's header. Entry 0
+ * is unused so that zero means "not compiled". */
+
+static code_t **codes = NULL;
+static unsigned int ncodes = 1, codes_size = 0;
+static unsigned int *free_codes = NULL;
+static unsigned int nfree = 0, free_size = 0;
+
+static unsigned int code_alloc (code_t * c)
+{
+  unsigned int i;
+  if (nfree > 0)
+    i = free_codes[--nfree];
+  else
+    {
+      if (ncodes == CODE_MAX)
+	return 0;
+      if (ncodes >= codes_size)
+	{
+	  codes_size = codes_size ? codes_size * 2 : 256;
+	  codes = xrealloc (codes, codes_size * sizeof (code_t *));
+	}
+      i = ncodes++;
+    }
+  codes[i] = c;
+  return i;
+}
+
+static code_t *code_create (int lexical)
+{
+  code_t *c = xmalloc (sizeof (code_t));
+  c->ops = NULL;
+  c->nops = c->nconsts = 0;
+  c->consts = NULL;
+  c->params = NULL;
+  c->nreq = c->nopt = c->rest = 0;
+  c->maxstack = c->maxbinds = 0;
+  c->lexical = lexical;
+  c->nlocals = c->framesize = 0;
+  c->slots = NULL;
+  return c;
+}
+
+static void code_destroy (code_t * c)
+{
+  size_t i;
+  for (i = 0; i < c->nconsts; i++)
+    obj_destroy (c->consts[i]);
+  xfree (c->consts);
+  xfree (c->ops);
+  xfree (c->params);
+  xfree (c->slots);
+  xfree (c);
+}
+
+void code_forget (object_t * key)
+{
+  code_t *c = codes[key->code];
+  if (nfree == free_size)
+    {
+      free_size = free_size ? free_size * 2 : 256;
+      free_codes = xrealloc (free_codes, free_size * sizeof (unsigned int));
+    }
+  free_codes[nfree++] = key->code;
+  key->code = 0;
+  code_destroy (c);
+}
+
+/* Compiler */
+
+typedef struct comp
+{
+  int *ops;
+  size_t nops, opsize;
+  object_t **consts;
+  size_t nconsts, csize;
+  int depth, maxdepth;
+  int binds, maxbinds;
+  int expansions, nesting;
+  struct stub *stubs;		/* fallbacks placed after the body */
+  size_t nstubs, stubsize;
+  int lexical;
+  int nlocals, maxlocals;
+  struct scope *scope;		/* innermost lexical scope */
+  struct captures *captured;	/* shared by all nested functions */
+  int redo;			/* a variable was found to be captured */
+  int failed;			/* a nested function can't be compiled */
+} comp_t;
+
+typedef struct stub
+{
+  size_t guard, cont;
+  object_t *form;
+  int *lex, nlex;		/* variables visible to the form */
+} stub_t;
+
+/* A lexical variable. The cons that binds it, a parameter list cell
+ * or a let binding, identifies it from one compilation to the next. */
+typedef struct lexvar
+{
+  object_t *sym, *site;
+  int heap;			/* kept in a frame, else a local */
+  int slot;
+} lexvar_t;
+
+/* Variables bound by one function or let. */
+typedef struct scope
+{
+  struct scope *up;
+  comp_t *c;			/* function the scope is in */
+  lexvar_t *vars;
+  int nvars;
+  int frame;			/* has a frame for its heap variables */
+} scope_t;
+
+/* Binding sites of captured variables. */
+typedef struct captures
+{
+  object_t **sites;
+  size_t n, size;
+} captures_t;
+
+static int captured (captures_t * cap, object_t * site)
+{
+  size_t i;
+  for (i = 0; i < cap->n; i++)
+    if (cap->sites[i] == site)
+      return 1;
+  return 0;
+}
+
+/* Record a captured site, returning 0 if it already was. */
+static int capture (captures_t * cap, object_t * site)
+{
+  if (captured (cap, site))
+    return 0;
+  if (cap->n == cap->size)
+    {
+      cap->size = cap->size ? cap->size * 2 : 16;
+      cap->sites = xrealloc (cap->sites, cap->size * sizeof (object_t *));
+    }
+  cap->sites[cap->n++] = site;
+  return 1;
+}
+
+/* Find the innermost lexical binding of sym, and the number of frames
+ * between here and the one it lives in. Using a local of an enclosing
+ * function captures it, so that function is compiled again. */
+static lexvar_t *lookup (comp_t * c, object_t * sym, int *depth)
+{
+  scope_t *s;
+  int i, d = 0;
+  for (s = c->scope; s != NULL; s = s->up)
+    {
+      for (i = s->nvars - 1; i >= 0; i--)
+	{
+	  lexvar_t *v = &s->vars[i];
+	  if (v->sym != sym)
+	    continue;
+	  if (s->c != c && !v->heap && capture (c->captured, v->site))
+	    s->c->redo = 1;
+	  *depth = d;
+	  return v;
+	}
+      if (s->frame)
+	d++;
+    }
+  return NULL;
+}
+
+static int new_local (comp_t * c)
+{
+  if (++c->nlocals > c->maxlocals)
+    c->maxlocals = c->nlocals;
+  return c->nlocals - 1;
+}
+
+static void compile_form (comp_t * c, object_t * form, int tail);
+
+static size_t emit (comp_t * c, int op)
+{
+  if (c->nops == c->opsize)
+    {
+      c->opsize *= 2;
+      c->ops = xrealloc (c->ops, c->opsize * sizeof (int));
+    }
+  c->ops[c->nops] = op;
+  return c->nops++;
+}
+
+/* Track the value stack depth as instructions are emitted. */
+static void stack_adjust (comp_t * c, int n)
+{
+  c->depth += n;
+  if (c->depth > c->maxdepth)
+    c->maxdepth = c->depth;
+}
+
+static int constant (comp_t * c, object_t * o)
+{
+  size_t i;
+  for (i = 0; i < c->nconsts; i++)
+    if (c->consts[i] == o)
+      return i;
+  if (c->nconsts == c->csize)
+    {
+      c->csize *= 2;
+      c->consts = xrealloc (c->consts, c->csize * sizeof (object_t *));
+    }
+  c->consts[c->nconsts] = UPREF (o);
+  return c->nconsts++;
+}
+
+/* Emit a jump whose target is filled in later by patch(). */
+static size_t emit_jump (comp_t * c, opcode_t op)
+{
+  emit (c, op);
+  return emit (c, -1);
+}
+
+static void patch (comp_t * c, size_t at)
+{
+  c->ops[at] = c->nops;
+}
+
+static void emit_const (comp_t * c, object_t * o)
+{
+  emit (c, OP_CONST);
+  emit (c, constant (c, o));
+  stack_adjust (c, 1);
+}
+
+/* Describe the lexical variables the tree walker should see as
+ * OP_EVAL operands, innermost first: those of this function, and those
+ * of enclosing functions that are in frames. The form is compiled
+ * here too, so any of the latter it uses are. Returns the number of
+ * variables, filling in out unless it is NULL. */
+static int visible (comp_t * c, int *out)
+{
+  scope_t *s;
+  int i, d = 0, n = 0;
+  for (s = c->scope; s != NULL; s = s->up)
+    {
+      for (i = s->nvars - 1; i >= 0; i--)
+	{
+	  lexvar_t *v = &s->vars[i];
+	  if (s->c != c && !v->heap)
+	    continue;
+	  if (out != NULL)
+	    {
+	      out[n * 3] = constant (c, v->sym);
+	      out[n * 3 + 1] = v->heap ? d : LEX_LOCAL;
+	      out[n * 3 + 2] = v->slot;
+	    }
+	  n++;
+	}
+      if (s->frame)
+	d++;
+    }
+  return n;
+}
+
+static void emit_eval (comp_t * c, object_t * form)
+{
+  int n = visible (c, NULL), lex[n * 3 + 1], i;
+  visible (c, lex);
+  emit (c, OP_EVAL);
+  emit (c, constant (c, form));
+  emit (c, n);
+  for (i = 0; i < n * 3; i++)
+    emit (c, lex[i]);
+  stack_adjust (c, 1);
+}
+
+static void emit_lexvar (comp_t * c, lexvar_t * v, int depth, int store)
+{
+  if (v->heap)
+    {
+      emit (c, store ? OP_SETENV : OP_ENV);
+      emit (c, depth);
+    }
+  else
+    emit (c, store ? OP_SETLOCAL : OP_LOCAL);
+  emit (c, v->slot);
+  if (!store)
+    stack_adjust (c, 1);
+}
+
+/* Open-coded forms are bracketed by these two. The fallback is kept
+ * out of line so the fast path doesn't jump over it. */
+static size_t begin_guard (comp_t * c, object_t * sym, object_t * val)
+{
+  emit (c, OP_GUARD);
+  emit (c, constant (c, sym));
+  emit (c, constant (c, val));
+  return emit (c, -1);
+}
+
+static void end_guard (comp_t * c, size_t guard, object_t * form)
+{
+  if (c->nstubs == c->stubsize)
+    {
+      c->stubsize *= 2;
+      c->stubs = xrealloc (c->stubs, c->stubsize * sizeof (stub_t));
+    }
+  stub_t *s = &c->stubs[c->nstubs++];
+  s->guard = guard;
+  s->cont = c->nops;
+  s->form = form;
+  s->nlex = visible (c, NULL);
+  s->lex = NULL;
+  if (s->nlex > 0)
+    {
+      s->lex = xmalloc (s->nlex * 3 * sizeof (int));
+      visible (c, s->lex);
+    }
+}
+
+static void emit_stubs (comp_t * c)
+{
+  size_t i;
+  int j;
+  for (i = 0; i < c->nstubs; i++)
+    {
+      stub_t *s = &c->stubs[i];
+      patch (c, s->guard);
+      emit (c, OP_EVAL);
+      emit (c, constant (c, s->form));
+      emit (c, s->nlex);
+      for (j = 0; j < s->nlex * 3; j++)
+	emit (c, s->lex[j]);
+      emit (c, OP_JUMP);
+      emit (c, s->cont);
+      xfree (s->lex);
+    }
+}
+
+/* Number of elements in a proper list, or -1. */
+static int list_length (object_t * lst)
+{
+  int n = 0;
+  while (CONSP (lst))
+    {
+      n++;
+      lst = CDR (lst);
+    }
+  return lst == NIL ? n : -1;
+}
+
+/* Forms compiled with tail set are the last thing their function
+ * does, so calls in them can reuse the caller's frame. */
+static void compile_body (comp_t * c, object_t * body, int tail)
+{
+  if (body == NIL)
+    {
+      emit_const (c, NIL);
+      return;
+    }
+  while (body != NIL)
+    {
+      compile_form (c, CAR (body), tail && CDR (body) == NIL);
+      body = CDR (body);
+      if (body != NIL)
+	{
+	  emit (c, OP_POP);
+	  c->depth--;
+	}
+    }
+}
+
+static void compile_if (comp_t * c, object_t * args, int tail)
+{
+  compile_form (c, CAR (args), 0);
+  size_t jelse = emit_jump (c, OP_JNIL);
+  c->depth--;
+  compile_form (c, CAR (CDR (args)), tail);
+  size_t jend = emit_jump (c, OP_JUMP);
+  c->depth--;
+  patch (c, jelse);
+  compile_body (c, CDR (CDR (args)), tail);
+  patch (c, jend);
+}
+
+/* Return 1 if the clauses are ones lisp_cond accepts. */
+static int cond_form (object_t * args)
+{
+  while (args != NIL)
+    {
+      if (!CONSP (args))
+	return 0;
+      object_t *pair = CAR (args);
+      if (!CONSP (pair) || !LISTP (CDR (pair)))
+	return 0;
+      if (CDR (pair) != NIL && CDR (CDR (pair)) != NIL)
+	return 0;
+      args = CDR (args);
+    }
+  return 1;
+}
+
+static void compile_cond (comp_t * c, object_t * args, int tail)
+{
+  size_t ends[list_length (args) + 1];
+  int n = 0;
+  for (; args != NIL; args = CDR (args))
+    {
+      object_t *pair = CAR (args);
+      if (CDR (pair) == NIL)
+	{
+	  /* A lone test is returned unevaluated. */
+	  emit_const (c, CAR (pair));
+	  c->depth--;
+	  ends[n++] = emit_jump (c, OP_JUMP);
+	  break;
+	}
+      compile_form (c, CAR (pair), 0);
+      size_t next = emit_jump (c, OP_JNIL);
+      c->depth--;
+      compile_form (c, CAR (CDR (pair)), tail);
+      c->depth--;
+      ends[n++] = emit_jump (c, OP_JUMP);
+      patch (c, next);
+    }
+  emit_const (c, NIL);
+  while (n > 0)
+    patch (c, ends[--n]);
+}
+
+static void compile_while (comp_t * c, object_t * args)
+{
+  emit_const (c, NIL);
+  size_t top = c->nops;
+  compile_form (c, CAR (args), 0);
+  size_t end = emit_jump (c, OP_JNIL);
+  c->depth--;
+  emit (c, OP_POP);
+  c->depth--;
+  compile_body (c, CDR (args), 0);
+  emit (c, OP_JUMP);
+  emit (c, top);
+  patch (c, end);
+}
+
+/* Return 1 if the bindings are ones let accepts. */
+static int let_form (object_t * args)
+{
+  if (!CONSP (args))
+    return 0;
+  object_t *vlist = CAR (args);
+  if (list_length (vlist) < 0)
+    return 0;
+  for (; vlist != NIL; vlist = CDR (vlist))
+    {
+      object_t *p = CAR (vlist);
+      if (!CONSP (p) || !SYMBOLP (CAR (p)) || !LISTP (CDR (p)))
+	return 0;
+    }
+  return 1;
+}
+
+/* Lexical let. Variables are bound one at a time, like the dynamic
+ * let, and those that are captured share a frame made on entry, so
+ * each time through a loop gets new ones. */
+static void compile_let_lexical (comp_t * c, object_t * args, int tail)
+{
+  object_t *vlist = CAR (args);
+  int n = list_length (vlist), base = c->nlocals, nheap = 0, i;
+  lexvar_t vars[n + 1];
+  scope_t s = { c->scope, c, vars, 0, 0 };
+  for (i = 0; i < n; i++, vlist = CDR (vlist))
+    {
+      vars[i].sym = CAR (CAR (vlist));
+      vars[i].site = CAR (vlist);
+      vars[i].heap = captured (c->captured, vars[i].site);
+      vars[i].slot = vars[i].heap ? ++nheap : new_local (c);
+    }
+  if (nheap > 0)
+    {
+      emit (c, OP_FRAME);
+      emit (c, nheap);
+      s.frame = 1;
+    }
+  c->scope = &s;
+  for (vlist = CAR (args); vlist != NIL; vlist = CDR (vlist))
+    {
+      object_t *pair = CAR (vlist);
+      if (CDR (pair) == NIL)
+	emit_const (c, NIL);
+      else
+	compile_form (c, CAR (CDR (pair)), 0);
+      emit_lexvar (c, &vars[s.nvars], 0, 1);
+      emit (c, OP_POP);
+      c->depth--;
+      s.nvars++;
+    }
+  compile_body (c, CDR (args), tail);
+  c->scope = s.up;
+  if (s.frame)
+    emit (c, OP_UNFRAME);
+  if (c->nlocals > base)
+    {
+      emit (c, OP_CLEAR);
+      emit (c, base);
+      emit (c, c->nlocals - base);
+    }
+  c->nlocals = base;
+}
+
+static void compile_let (comp_t * c, object_t * args, int tail)
+{
+  if (c->lexical)
+    {
+      compile_let_lexical (c, args, tail);
+      return;
+    }
+  object_t *vlist;
+  int n = 0;
+  for (vlist = CAR (args); vlist != NIL; vlist = CDR (vlist))
+    {
+      object_t *pair = CAR (vlist);
+      if (CDR (pair) == NIL)
+	emit_const (c, NIL);
+      else
+	compile_form (c, CAR (CDR (pair)), 0);
+      emit (c, OP_BIND);
+      emit (c, constant (c, CAR (pair)));
+      c->depth--;
+      n++;
+      if (++c->binds > c->maxbinds)
+	c->maxbinds = c->binds;
+    }
+  compile_body (c, CDR (args), tail);
+  if (n > 0)
+    {
+      emit (c, OP_UNBIND);
+      emit (c, n);
+      c->binds -= n;
+    }
+}
+
+/* and/or: stop at the first argument that is nil/non-nil. */
+static void compile_andor (comp_t * c, object_t * args, opcode_t op,
+			   object_t * empty, int tail)
+{
+  if (args == NIL)
+    {
+      emit_const (c, empty);
+      return;
+    }
+  size_t ends[list_length (args)];
+  int n = 0;
+  while (CDR (args) != NIL)
+    {
+      compile_form (c, CAR (args), 0);
+      ends[n++] = emit_jump (c, op);
+      c->depth--;
+      args = CDR (args);
+    }
+  compile_form (c, CAR (args), tail);
+  while (n > 0)
+    patch (c, ends[--n]);
+}
+
+static void compile_args (comp_t * c, object_t * args)
+{
+  for (; args != NIL; args = CDR (args))
+    compile_form (c, CAR (args), 0);
+}
+
+/* Call the function already pushed. */
+static void compile_funcall (comp_t * c, object_t * args, int tail)
+{
+  int argc = list_length (args);
+  compile_args (c, args);
+  emit (c, tail ? OP_TAILCALL : OP_CALL);
+  emit (c, argc);
+  c->depth -= argc;
+}
+
+static void compile_catch (comp_t * c, object_t * args)
+{
+  compile_form (c, CAR (args), 0);
+  size_t handler = emit_jump (c, OP_CATCH);
+  c->depth--;
+  compile_body (c, CDR (args), 0);
+  emit (c, OP_UNCATCH);
+  patch (c, handler);
+}
+
+static void compile (code_t * code, object_t * vars, object_t * body,
+		     comp_t * up);
+
+/* A lambda in lexical code makes a closure over the frames in use
+ * where it is evaluated. Its code is kept with a copy of the cons
+ * holding its parameters and body, since it is only right for this
+ * one place. */
+static void compile_lambda (comp_t * c, object_t * fn)
+{
+  object_t *tmpl = c_cons (UPREF (CAR (fn)), UPREF (CDR (fn)));
+  code_t *code = code_create (1);
+  tmpl->code = code_alloc (code);
+  if (tmpl->code == 0)
+    {
+      xfree (code);
+      c->failed = 1;
+    }
+  else
+    {
+      compile (code, CAR (fn), CDR (fn), c);
+      if (code->ops == NULL)
+	c->failed = 1;
+    }
+  emit (c, OP_CLOSURE);
+  emit (c, constant (c, tmpl));
+  stack_adjust (c, 1);
+  obj_destroy (tmpl);
+}
+
+static int prim_index (object_t * val)
+{
+  int i;
+  for (i = 0; prims[i] != NULL; i++)
+    if (prims[i] == val)
+      return i;
+  return -1;
+}
+
+/* Compile a call whose function is a symbol. */
+static void compile_call (comp_t * c, object_t * form, int tail)
+{
+  object_t *head = CAR (form), *args = CDR (form);
+  object_t *val = GET (head);
+  int argc = list_length (args);
+  if (argc < 0)
+    {
+      emit_eval (c, form);
+      return;
+    }
+
+  /* A lexical variable holding a function */
+  int depth;
+  lexvar_t *v = lookup (c, head, &depth);
+  if (v != NULL)
+    {
+      emit_lexvar (c, v, depth, 0);
+      compile_funcall (c, args, tail);
+      return;
+    }
+
+  size_t guard;
+  int start = c->depth;
+  if (val->type == SPECIAL)
+    {
+      if (val == sp_quote && argc == 1)
+	{
+	  guard = begin_guard (c, head, val);
+	  emit_const (c, CAR (args));
+	}
+      else if (val == sp_if && argc >= 2)
+	{
+	  guard = begin_guard (c, head, val);
+	  compile_if (c, args, tail);
+	}
+      else if (val == sp_cond && cond_form (args))
+	{
+	  guard = begin_guard (c, head, val);
+	  compile_cond (c, args, tail);
+	}
+      else if (val == sp_while && argc >= 1)
+	{
+	  guard = begin_guard (c, head, val);
+	  compile_while (c, args);
+	}
+      else if (val == sp_let && let_form (args))
+	{
+	  guard = begin_guard (c, head, val);
+	  compile_let (c, args, tail);
+	}
+      else if (val == sp_progn)
+	{
+	  guard = begin_guard (c, head, val);
+	  compile_body (c, args, tail);
+	}
+      else if (val == sp_and || val == sp_or)
+	{
+	  guard = begin_guard (c, head, val);
+	  if (val == sp_and)
+	    compile_andor (c, args, OP_JNIL_KEEP, T, tail);
+	  else
+	    compile_andor (c, args, OP_JTRUE_KEEP, NIL, tail);
+	}
+      else if (val == sp_catch && argc >= 1)
+	{
+	  guard = begin_guard (c, head, val);
+	  compile_catch (c, args);
+	}
+      else if (c->lexical && val == sp_lambda && argc >= 1
+	       && is_func_form (args))
+	{
+	  guard = begin_guard (c, head, val);
+	  compile_lambda (c, args);
+	}
+      else if (c->lexical && val == sp_defun && argc >= 2
+	       && SYMBOLP (CAR (args)) && is_func_form (CDR (args)))
+	{
+	  guard = begin_guard (c, head, val);
+	  compile_lambda (c, CDR (args));
+	  emit (c, OP_SET);
+	  emit (c, constant (c, CAR (args)));
+	  emit (c, OP_POP);
+	  c->depth--;
+	  emit_const (c, CAR (args));
+	}
+      else
+	{
+	  emit_eval (c, form);
+	  return;
+	}
+    }
+  else if (val->type == CONS && CAR (val) == macro)
+    {
+      object_t *exp = NULL;
+      if (c->expansions < MAX_EXPANSIONS && c->nesting < MAX_NESTING)
+	{
+	  exp = macro_expand_form (val, form);
+	  if (exp == err_symbol)
+	    {
+	      /* The error is raised again when the form is run. */
+	      obj_destroy (err_thrown);
+	      obj_destroy (err_attach);
+	      err_thrown = err_attach = NIL;
+	      exp = NULL;
+	    }
+	}
+      if (exp == NULL)
+	{
+	  emit_eval (c, form);
+	  return;
+	}
+      c->expansions++;
+      guard = begin_guard (c, head, val);
+      constant (c, exp);
+      obj_destroy (exp);
+      compile_form (c, exp, tail);
+    }
+  else if (val == cf_set && argc == 2 && CONSP (CAR (args))
+	   && CAR (CAR (args)) == quote && list_length (CAR (args)) == 2
+	   && SYMBOLP (CAR (CDR (CAR (args))))
+	   && !CONSTANTP (CAR (CDR (CAR (args)))))
+    {
+      object_t *sym = CAR (CDR (CAR (args)));
+      guard = begin_guard (c, head, val);
+      compile_form (c, CAR (CDR (args)), 0);
+      if ((v = lookup (c, sym, &depth)) != NULL)
+	emit_lexvar (c, v, depth, 1);
+      else
+	{
+	  emit (c, OP_SET);
+	  emit (c, constant (c, sym));
+	}
+    }
+  else if (argc <= PRIM_MAX && prim_index (val) >= 0)
+    {
+      /* Constants and variables are read by the instruction itself,
+       * unless a later argument could change the variable. */
+      int src[PRIM_MAX], i, direct = 1, pushed = 0;
+      object_t *p;
+      for (i = argc - 1; i >= 0; i--)
+	{
+	  object_t *arg = args;
+	  int j;
+	  for (j = 0; j < i; j++)
+	    arg = CDR (arg);
+	  arg = CAR (arg);
+	  v = SYMBOLP (arg) ? lookup (c, arg, &depth) : NULL;
+	  if (direct && v != NULL && !v->heap)
+	    src[i] = PRIM_LOCAL (v->slot);
+	  else if (direct && SYMBOLP (arg) && v == NULL)
+	    src[i] = PRIM_VAR (constant (c, arg));
+	  else if (direct && !CONSP (arg) && !SYMBOLP (arg))
+	    src[i] = PRIM_CONST (constant (c, arg));
+	  else
+	    {
+	      direct = 0;
+	      src[i] = PRIM_STACK;
+	      pushed++;
+	    }
+	}
+      /* With nothing to evaluate first, the instruction does its own
+       * guard check. */
+      if (pushed > 0)
+	{
+	  guard = begin_guard (c, head, val);
+	  for (i = 0, p = args; i < argc; i++, p = CDR (p))
+	    if (src[i] == PRIM_STACK)
+	      compile_form (c, CAR (p), 0);
+	}
+      emit (c, OP_PRIM);
+      emit (c, argc);
+      emit (c, constant (c, val));
+      emit (c, prim_index (val));
+      if (pushed > 0)
+	{
+	  emit (c, -1);
+	  emit (c, 0);
+	}
+      else
+	{
+	  emit (c, constant (c, head));
+	  guard = emit (c, -1);
+	}
+      for (i = 0; i < argc; i++)
+	emit (c, src[i]);
+      c->depth -= pushed;
+      stack_adjust (c, 1);
+    }
+  else
+    {
+      /* Ordinary function call, resolved at run time. */
+      emit (c, OP_FUNC);
+      emit (c, constant (c, head));
+      guard = emit (c, -1);
+      stack_adjust (c, 1);
+      compile_funcall (c, args, tail);
+    }
+  c->depth = start + 1;
+  end_guard (c, guard, form);
+}
+
+static void compile_form (comp_t * c, object_t * form, int tail)
+{
+  c->nesting++;
+  if (SYMBOLP (form))
+    {
+      int depth;
+      lexvar_t *v;
+      if (form == NIL || form == T)
+	emit_const (c, form);
+      else if ((v = lookup (c, form, &depth)) != NULL)
+	emit_lexvar (c, v, depth, 0);
+      else
+	{
+	  emit (c, OP_VAR);
+	  emit (c, constant (c, form));
+	  stack_adjust (c, 1);
+	}
+    }
+  else if (!CONSP (form))
+    emit_const (c, form);
+  else if (SYMBOLP (CAR (form)))
+    compile_call (c, form, tail);
+  else if (c->lexical && list_length (CDR (form)) >= 0)
+    {
+      compile_form (c, CAR (form), 0);
+      compile_funcall (c, CDR (form), tail);
+    }
+  else
+    emit_eval (c, form);
+  c->nesting--;
+}
+
+static void compile (code_t * code, object_t * vars, object_t * body,
+		     comp_t * up)
+{
+  if (list_length (body) < 0 || list_length (vars) < 0
+      || !is_var_list (vars))
+    return;
+
+  /* Parameters */
+  int nvars = list_length (vars);
+  object_t *sites[nvars + 1];
+  code->params = xmalloc ((nvars + 1) * sizeof (object_t *));
+  int n = 0, optional_mode = 0;
+  for (; vars != NIL; vars = CDR (vars))
+    {
+      object_t *var = CAR (vars);
+      if (var == optional)
+	optional_mode = 1;
+      else if (var == rest)
+	{
+	  sites[n] = CDR (vars);
+	  code->params[n++] = CAR (CDR (vars));
+	  code->rest = 1;
+	  break;
+	}
+      else
+	{
+	  sites[n] = vars;
+	  code->params[n++] = var;
+	  if (optional_mode)
+	    code->nopt++;
+	  else
+	    code->nreq++;
+	}
+    }
+
+  captures_t top = { NULL, 0, 0 };
+  lexvar_t params[n + 1];
+  scope_t scope = { up != NULL ? up->scope : NULL, NULL, params, n, 0 };
+  comp_t c;
+  scope.c = &c;
+  do
+    {
+      c.opsize = 64;
+      c.ops = xmalloc (c.opsize * sizeof (int));
+      c.csize = 16;
+      c.consts = xmalloc (c.csize * sizeof (object_t *));
+      c.nops = c.nconsts = 0;
+      c.depth = c.maxdepth = c.binds = c.maxbinds = 0;
+      c.expansions = c.nesting = 0;
+      c.stubsize = 16;
+      c.stubs = xmalloc (c.stubsize * sizeof (stub_t));
+      c.nstubs = 0;
+      c.lexical = code->lexical;
+      c.nlocals = c.maxlocals = 0;
+      c.scope = NULL;
+      c.captured = up != NULL ? up->captured : &top;
+      c.redo = c.failed = 0;
+      if (code->lexical)
+	{
+	  int i, nheap = 0;
+	  code->slots = xrealloc (code->slots, (n + 1) * sizeof (int));
+	  for (i = 0; i < n; i++)
+	    {
+	      params[i].sym = code->params[i];
+	      params[i].site = sites[i];
+	      params[i].heap = captured (c.captured, sites[i]);
+	      params[i].slot = params[i].heap ? ++nheap : new_local (&c);
+	      code->slots[i] =
+		params[i].heap ? -params[i].slot : params[i].slot;
+	    }
+	  code->framesize = nheap;
+	  scope.frame = nheap > 0;
+	  c.scope = &scope;
+	}
+      compile_body (&c, body, 1);
+      emit (&c, OP_RETURN);
+      emit_stubs (&c);
+      xfree (c.stubs);
+      if (c.redo || c.failed)
+	{
+	  size_t i;
+	  for (i = 0; i < c.nconsts; i++)
+	    obj_destroy (c.consts[i]);
+	  xfree (c.consts);
+	  xfree (c.ops);
+	}
+    }
+  while (c.redo && !c.failed);
+  xfree (top.sites);
+  if (c.failed)
+    return;
+
+  code->ops = c.ops;
+  code->nops = c.nops;
+  code->consts = c.consts;
+  code->nconsts = c.nconsts;
+  code->maxstack = c.maxdepth;
+  code->maxbinds = c.maxbinds;
+  code->nlocals = c.maxlocals;
+}
+
+code_t *code_get (object_t * f)
+{
+  object_t *key = CLOSUREP (f) ? CLOSURE_FN (f) : CDR (f);
+  if (!CONSP (key))
+    return NULL;
+  if (key->code)
+    {
+      if (key->expanded)
+	return NULL;		/* also a macro call site */
+      code_t *c = codes[key->code];
+      return c->ops == NULL ? NULL : c;
+    }
+
+  /* Enter it first: macro expansion may call this function, which
+   * runs in the tree walker until compilation is done. */
+  code_t *c = code_create (CLOSUREP (f));
+  key->code = code_alloc (c);
+  if (key->code == 0)
+    {
+      xfree (c);
+      return NULL;
+    }
+  compile (c, CAR (key), CDR (key), NULL);
+  return c->ops == NULL ? NULL : c;
+}
@@ -1,34 +1,9 @@
 #include <stdio.h>
-#include "mem.h"
 #include "object.h"
 #include "symtab.h"
 #include "cons.h"
 #include "eval.h"
 
-static mmanager_t *mm;
-
-static void cons_clear (void *o)
-{
-  cons_t *c = (cons_t *) o;
-  c->car = NIL;
-  c->cdr = NIL;
-}
-
-void cons_init ()
-{
-  mm = mm_create (sizeof (cons_t), &cons_clear);
-}
-
-cons_t *cons_create ()
-{
-  return (cons_t *) mm_alloc (mm);
-}
-
-void cons_destroy (cons_t * o)
-{
-  mm_free (mm, (void *) o);
-}
-
 object_t *req_length (object_t * lst, object_t * thr, int n)
 {
   /* TODO detect loops? */
@@ -138,7 +113,15 @@ object_t *properlistp (object_t * lst)
   return properlistp (CDR (lst));
 }
 
-uint32_t cons_hash (object_t * o)
+uint32_t cons_hash (object_t * o, int depth)
 {
-  return obj_hash (CAR (o)) ^ obj_hash (CDR (o));
+  uint32_t h = CONS;
+  int n;
+  if (depth >= HASH_DEPTH)
+    return h;
+  for (n = 0; CONSP (o) && n < HASH_LENGTH; n++, o = CDR (o))
+    h = hash_combine (h, obj_hash_depth (CAR (o), depth + 1));
+  if (!CONSP (o))
+    h = hash_combine (h, obj_hash_depth (o, depth + 1));
+  return h;
 }
@@ -4,18 +4,7 @@
 
 #include "object.h"
 
-typedef struct cons
-{
-  object_t *car;
-  object_t *cdr;
-} cons_t;
-
-/* Must be called before any other functions. */
-void cons_init ();
-
-/* Memory management */
-cons_t *cons_create ();
-void cons_destroy (cons_t * c);
+typedef struct cons cons_t;
 
 /* list operators */
 object_t *req_length (object_t * lst, object_t * thr, int n);	/* exact */
@@ -24,8 +13,8 @@ object_t *reqx_length (object_t * lst, object_t * thr, int n);	/* max */
 int is_func_form (object_t * lst);
 int is_var_list (object_t * lst);
 
-#define CAR(o) ((cons_t *) OVAL(o))->car
-#define CDR(o) ((cons_t *) OVAL(o))->cdr
+#define CAR(o) ((o)->uval.cons.car)
+#define CDR(o) ((o)->uval.cons.cdr)
 
 #define LISTP(o) (o->type == CONS || o == NIL)
 #define PAIRP(o) (o->type == CONS && !LISTP(CDR(o)))
@@ -33,6 +22,6 @@ int is_var_list (object_t * lst);
 /* Determine if list is proper. */
 object_t *properlistp (object_t * t);
 
-uint32_t cons_hash (object_t * o);
+uint32_t cons_hash (object_t * o, int depth);
 
 #endif /* CONS_H */
@@ -0,0 +1,254 @@
+/* cycle.c - synchronous trial deletion cycle collector
+ *
+ * Containers (conses, vectors, hash tables and closures) that survive a
+ * decrement may be the root of a garbage cycle, so they are buffered. A
+ * collection subtracts the internal references from everything
+ * reachable from the buffered roots. Anything left with a zero count is only
+ * referenced by the cycle itself and is freed. Every traversal uses an
+ * explicit stack so long lists don't overflow the C stack. */
+#include <time.h>
+#include "common.h"
+#include "object.h"
+#include "cons.h"
+#include "symtab.h"
+#include "vector.h"
+#include "hashtable.h"
+#include "cycle.h"
+
+size_t cc_threshold = 100000;
+size_t cc_pending = 0;
+size_t cc_collections = 0, cc_reclaimed = 0;
+double cc_seconds = 0;
+
+/* Possible cycle roots */
+static object_t **roots = NULL;
+static size_t nroots = 0, roots_size = 0;
+
+/* Traversal stack */
+typedef struct cc_stack
+{
+  object_t **base;
+  size_t count, size;
+} cc_stack_t;
+
+static cc_stack_t stack, black_stack, garbage;
+
+static void push (cc_stack_t * s, object_t * o)
+{
+  if (s->count == s->size)
+    {
+      s->size = s->size ? s->size * 2 : 1024;
+      s->base = xrealloc (s->base, s->size * sizeof (object_t *));
+    }
+  s->base[s->count++] = o;
+}
+
+static object_t *pop (cc_stack_t * s)
+{
+  return s->base[--s->count];
+}
+
+/* Number of children an object has, and the ith child. Empty hash
+ * table slots count as children, which are nil. */
+static size_t child_count (object_t * o)
+{
+  if (o->type == CONS || o->type == CLOSURE)
+    return 2;
+  if (o->type == HASHTABLE)
+    return OHASH (o)->size * 2;
+  return VLENGTH (o);
+}
+
+static object_t *child (object_t * o, size_t i)
+{
+  if (o->type == CONS || o->type == CLOSURE)
+    return i == 0 ? CAR (o) : CDR (o);
+  if (o->type == HASHTABLE)
+    {
+      hashtable_entry_t *e = &OHASH (o)->arr[i / 2];
+      if (e->key == NULL)
+	return NIL;
+      return i % 2 == 0 ? e->key : e->value;
+    }
+  return OVEC (o)->v[i];
+}
+
+void cycle_candidate (object_t * o)
+{
+  cc_pending++;
+  if (o->color == CC_PURPLE)
+    return;
+  o->color = CC_PURPLE;
+  if (!o->buffered)
+    {
+      o->buffered = 1;
+      if (nroots == roots_size)
+	{
+	  roots_size = roots_size ? roots_size * 2 : 1024;
+	  roots = xrealloc (roots, roots_size * sizeof (object_t *));
+	}
+      roots[nroots++] = o;
+    }
+}
+
+/* Remove internal references from everything reachable from o. */
+static void mark_gray (object_t * o)
+{
+  if (o->color == CC_GRAY)
+    return;
+  o->color = CC_GRAY;
+  push (&stack, o);
+  while (stack.count > 0)
+    {
+      object_t *p = pop (&stack);
+      size_t i, n = child_count (p);
+      for (i = 0; i < n; i++)
+	{
+	  object_t *c = child (p, i);
+	  if (!CONTAINERP (c))
+	    continue;
+	  c->refs--;
+	  if (c->color != CC_GRAY)
+	    {
+	      c->color = CC_GRAY;
+	      push (&stack, c);
+	    }
+	}
+    }
+}
+
+/* Restore references of everything reachable from live object o. */
+static void scan_black (object_t * o)
+{
+  o->color = CC_BLACK;
+  push (&black_stack, o);
+  while (black_stack.count > 0)
+    {
+      object_t *p = pop (&black_stack);
+      size_t i, n = child_count (p);
+      for (i = 0; i < n; i++)
+	{
+	  object_t *c = child (p, i);
+	  if (!CONTAINERP (c))
+	    continue;
+	  c->refs++;
+	  if (c->color != CC_BLACK)
+	    {
+	      c->color = CC_BLACK;
+	      push (&black_stack, c);
+	    }
+	}
+    }
+}
+
+/* Anything gray with remaining references is externally reachable. */
+static void scan (object_t * o)
+{
+  push (&stack, o);
+  while (stack.count > 0)
+    {
+      object_t *p = pop (&stack);
+      if (p->color != CC_GRAY)
+	continue;
+      if (p->refs > 0)
+	{
+	  scan_black (p);
+	  continue;
+	}
+      p->color = CC_WHITE;
+      size_t i, n = child_count (p);
+      for (i = 0; i < n; i++)
+	if (CONTAINERP (child (p, i)))
+	  push (&stack, child (p, i));
+    }
+}
+
+/* Gather the garbage cycle containing o. Nothing is freed until all
+ * roots have been visited, since roots may belong to the same cycle. */
+static void collect_white (object_t * o)
+{
+  if (o->color != CC_WHITE)
+    return;
+  o->color = CC_BLACK;
+  push (&stack, o);
+  while (stack.count > 0)
+    {
+      object_t *p = pop (&stack);
+      push (&garbage, p);
+      size_t i, n = child_count (p);
+      for (i = 0; i < n; i++)
+	{
+	  object_t *c = child (p, i);
+	  if (CONTAINERP (c) && c->color == CC_WHITE)
+	    {
+	      c->color = CC_BLACK;
+	      push (&stack, c);
+	    }
+	}
+    }
+}
+
+/* Free a garbage object. References to other garbage and to black
+ * objects were already removed by mark_gray() and never restored, so
+ * only the non-container children still need a decrement. */
+static void free_white (object_t * o)
+{
+  size_t i, n = child_count (o);
+  for (i = 0; i < n; i++)
+    if (!CONTAINERP (child (o, i)))
+      obj_destroy (child (o, i));
+  if (o->type == VECTOR)
+    xfree (OVEC (o)->v);
+  else if (o->type == HASHTABLE)
+    {
+      xfree (OHASH (o)->arr);
+      xfree (OVAL (o));
+    }
+  obj_free (o);
+}
+
+size_t cycle_collect ()
+{
+  struct timespec start, end;
+  clock_gettime (CLOCK_MONOTONIC, &start);
+  size_t i, n = 0, count = 0;
+
+  /* Drop roots that are no longer candidates. This is done before
+   * marking, since freeing a compiled function or a form with a cached
+   * expansion releases what it holds, which may buffer more roots. */
+  for (i = 0; i < nroots; i++)
+    {
+      object_t *o = roots[i];
+      if (o->color == CC_PURPLE && o->refs > 0)
+	roots[n++] = o;
+      else
+	{
+	  o->buffered = 0;
+	  if (o->color == CC_BLACK && o->refs == 0)
+	    obj_free (o);
+	}
+    }
+  nroots = n;
+
+  for (i = 0; i < nroots; i++)
+    mark_gray (roots[i]);
+  for (i = 0; i < nroots; i++)
+    scan (roots[i]);
+
+  for (i = 0; i < nroots; i++)
+    roots[i]->buffered = 0;
+  for (i = 0; i < nroots; i++)
+    collect_white (roots[i]);
+  nroots = 0;
+  cc_pending = 0;
+  count = garbage.count;
+  while (garbage.count > 0)
+    free_white (pop (&garbage));
+
+  clock_gettime (CLOCK_MONOTONIC, &end);
+  cc_collections++;
+  cc_reclaimed += count;
+  cc_seconds += (end.tv_sec - start.tv_sec)
+    + (end.tv_nsec - start.tv_nsec) / 1e9;
+  return count;
+}
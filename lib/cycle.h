@@ -0,0 +1,35 @@
+/* cycle.h - synchronous cycle collector for reference counting */
+#ifndef CYCLE_H
+#define CYCLE_H
+
+#include "object.h"
+
+/* Object colors, as in Bacon and Rajan's trial deletion. */
+#define CC_BLACK 0		/* in use or free */
+#define CC_GRAY 1		/* possible member of cycle */
+#define CC_WHITE 2		/* member of garbage cycle */
+#define CC_PURPLE 3		/* possible root of cycle */
+
+/* Objects that can form cycles. */
+#define CONTAINERP(o) ((o)->type == CONS || (o)->type == VECTOR \
+                       || (o)->type == HASHTABLE || (o)->type == CLOSURE)
+
+/* Called by obj_destroy() when a container survives a decrement. */
+void cycle_candidate (object_t * o);
+
+/* Reclaim all garbage cycles, returning the number of objects freed. */
+size_t cycle_collect ();
+
+/* Decrements between automatic collections, 0 to disable. */
+extern size_t cc_threshold;
+extern size_t cc_pending;
+
+/* Statistics */
+extern size_t cc_collections, cc_reclaimed;
+extern double cc_seconds;
+
+/* Collect at a safe point if enough decrements have built up. */
+#define CYCLE_CHECK() if (cc_threshold && cc_pending >= cc_threshold) \
+                        cycle_collect ();
+
+#endif /* CYCLE_H */
@@ -1,111 +1,757 @@
+/* detach.c - processes that send objects back to their parent
+ *
+ * Objects travel over a pipe in the binary encoding from fasl.c, one
+ * stream per direction, so symbol names are only sent once. The
+ * stream is cut into frames, each a 4 byte length followed by that
+ * many bytes of encoded objects, and each frame is written with a
+ * single write(). */
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
 #include <errno.h>
 #include <unistd.h>
+#include <sys/wait.h>
+#include <poll.h>
+#include <time.h>
 #include "object.h"
 #include "symtab.h"
+#include "cons.h"
 #include "eval.h"
-#include "reader.h"
+#include "number.h"
+#include "vector.h"
+#include "fasl.h"
 #include "detach.h"
 
 object_t *parent_detach;
 
-uint8_t detach_hash (object_t * o)
+uint32_t detach_hash (object_t * o)
 {
   pid_t proc = OPROC (o);
-  return hash (&proc, sizeof (pid_t));
+  return word_hash (proc);
 }
 
-void detach_print (object_t * o)
+void detach_print (printer_t * p, object_t * o)
 {
   pid_t proc = OPROC (o);
-  printf ("<detach %d>", proc);
+  char buf[32];
+  snprintf (buf, sizeof (buf), "<detach %d>", proc);
+  printer_puts (p, buf);
 }
 
-object_t *c_detach (object_t * o)
+/* Bytes read from the pipe at a time. */
+#define DETACH_BLOCK 65536
+
+/* Bytes in a frame's length. */
+#define FRAME_HEADER 4
+
+/* Fork a process that calls child (arg) and exits. The parent gets
+ * the detachment. */
+static object_t *detach_spawn (void (*child) (void *), void *arg)
 {
-  if (SYMBOLP (o))
-    o = GET (o);
-  object_t *dob = obj_create (DETACH);
-  detach_t *d = OVAL (dob);
   int pipea[2], pipeb[2];
   if (pipe (pipea) != 0)
-    THROW (c_sym ("detach-pipe-error"), c_strs (xstrdup (strerror (errno))));
+    THROW (detach_pipe_error, c_strs (xstrdup (strerror (errno))));
   if (pipe (pipeb) != 0)
-    THROW (c_sym ("detach-pipe-error"), c_strs (xstrdup (strerror (errno))));
+    {
+      close (pipea[0]);
+      close (pipea[1]);
+      THROW (detach_pipe_error, c_strs (xstrdup (strerror (errno))));
+    }
+  object_t *dob = obj_create (DETACH);
+  detach_t *d = OVAL (dob);
+  /* Don't let the child write out the parent's buffered output. */
+  fflush (stdout);
   d->proc = fork ();
   if (d->proc == 0)
     {
       /* Child process */
 
-      /* Set up pipes */
+      /* Set up pipes, leaving stdout alone so printing can't get in
+       * the way of sent objects. */
       d->in = pipeb[0];
       d->out = pipea[1];
       close (pipeb[1]);
       close (pipea[0]);
-
-      /* Change stdin and stdout. */
       fclose (stdin);
-      int stdout_no = fileno (stdout);
-      close (stdout_no);
-      dup2 (d->out, stdout_no);
-      d->read = reader_create (fdopen (d->in, "r"), NULL, "parent", 0);
+      d->read = fasl_reader_create (NULL, NULL, 0, "parent");
       parent_detach = dob;
 
-      /* Execute given function. */
-      object_t *f = c_cons (o, NIL);
-      eval (f);
+      child (arg);
       exit (0);
-      THROW (c_sym ("exit-failed"), dob);
     }
   /* Parent process */
   d->in = pipea[0];
   d->out = pipeb[1];
   close (pipea[1]);
   close (pipeb[0]);
-  d->read = reader_create (fdopen (d->in, "r"), NULL, "detach", 0);
+  d->read = fasl_reader_create (NULL, NULL, 0, "detach");
+  if (d->proc < 0)
+    {
+      char *msg = xstrdup (strerror (errno));
+      obj_destroy (dob);
+      THROW (detach_pipe_error, c_strs (msg));
+    }
   return dob;
 }
 
+static void call_function (void *f)
+{
+  object_t *form = c_cons (f, NIL);
+  eval (form);
+}
+
+object_t *c_detach (object_t * o)
+{
+  if (SYMBOLP (o))
+    o = GET (o);
+  return detach_spawn (&call_function, o);
+}
+
 detach_t *detach_create ()
 {
-  return (detach_t *) xmalloc (sizeof (detach_t));
+  detach_t *d = xmalloc (sizeof (detach_t));
+  d->in = d->out = -1;
+  d->proc = 0;
+  d->read = NULL;
+  d->write = fasl_writer_create (NULL);
+  d->size = DETACH_BLOCK;
+  d->buf = xmalloc (d->size);
+  d->start = d->end = d->frame_end = 0;
+  d->eof = 0;
+  d->reported = 0;
+  return d;
 }
 
 void detach_destroy (object_t * o)
 {
   detach_t *d = OVAL (o);
-  reader_destroy (d->read);
+  if (d->read != NULL)
+    fasl_reader_destroy (d->read);
+  fasl_writer_destroy (d->write);
+  xfree (d->buf);
   close (d->in);
   close (d->out);
 }
 
+/* Writing */
+
+static object_t *write_all (int fd, char *buf, size_t len)
+{
+  while (len > 0)
+    {
+      ssize_t n = write (fd, buf, len);
+      if (n < 0 && errno == EINTR)
+	continue;
+      if (n <= 0)
+	THROW (detach_pipe_error, c_strs (xstrdup (strerror (errno))));
+      buf += n;
+      len -= n;
+    }
+  return T;
+}
+
+/* Encode each object in the list lst, or just o when lst is NULL, into
+ * one frame and write it out. Nothing is written if any object has no
+ * encoding. */
+static object_t *send_frame (detach_t * d, object_t * o, object_t * lst)
+{
+  fasl_writer_t *w = d->write;
+  int started = w->started;
+  size_t nsyms = w->nsyms;
+  w->len = FRAME_HEADER;	/* filled in once the length is known */
+  object_t *r = T;
+  if (lst == NULL)
+    r = fasl_write (w, o);
+  else
+    for (; CONSP (lst) && r != err_symbol; lst = CDR (lst))
+      r = fasl_write (w, CAR (lst));
+  if (r == err_symbol)
+    {
+      fasl_rewind (w, 0, nsyms);
+      w->started = started;
+      return err_symbol;
+    }
+  size_t len = w->len - FRAME_HEADER;
+  if (len > UINT32_MAX)
+    {
+      fasl_rewind (w, 0, nsyms);
+      w->started = started;
+      THROW (detach_pipe_error, c_strs (xstrdup ("frame too large")));
+    }
+  int i;
+  for (i = 0; i < FRAME_HEADER; i++)
+    w->buf[i] = (len >> (8 * i)) & 0xff;
+  r = write_all (d->out, w->buf, w->len);
+  w->len = 0;
+  return r;
+}
+
+/* Reading */
+
+/* Read more of the pipe into the buffer, returning 0 at the end. This
+ * is a single read(), so it doesn't block once poll() has found the
+ * pipe readable. */
+static int detach_fill (detach_t * d)
+{
+  if (d->start > 0)
+    {
+      memmove (d->buf, d->buf + d->start, d->end - d->start);
+      d->end -= d->start;
+      d->frame_end -= d->start;
+      d->start = 0;
+    }
+  if (d->end == d->size)
+    {
+      d->size *= 2;
+      d->buf = xrealloc (d->buf, d->size);
+    }
+  ssize_t n;
+  do
+    n = read (d->in, d->buf + d->end, d->size - d->end);
+  while (n < 0 && errno == EINTR);
+  if (n <= 0)
+    {
+      d->eof = 1;
+      return 0;
+    }
+  d->end += n;
+  return 1;
+}
+
+/* Make the next frame the reader's input. Returns 0 if the pipe ends
+ * first. */
+static int next_frame (detach_t * d)
+{
+  size_t len = 0;
+  int i;
+  d->start = d->frame_end;
+  while (d->end - d->start < FRAME_HEADER)
+    if (!detach_fill (d))
+      return 0;
+  for (i = 0; i < FRAME_HEADER; i++)
+    len |= (size_t) (unsigned char) d->buf[d->start + i] << (8 * i);
+  while (d->end - d->start < FRAME_HEADER + len)
+    {
+      if (d->size - d->start < FRAME_HEADER + len)
+	{
+	  /* Grow to fit the whole frame in one go. */
+	  while (d->size - d->start < FRAME_HEADER + len)
+	    d->size *= 2;
+	  d->buf = xrealloc (d->buf, d->size);
+	}
+      if (!detach_fill (d))
+	return 0;
+    }
+  d->frame_end = d->start + FRAME_HEADER + len;
+  d->read->inp = d->buf + d->start + FRAME_HEADER;
+  d->read->inend = d->buf + d->frame_end;
+  return 1;
+}
+
+/* Return non-zero if receiving from d won't block: an object is left
+ * in the current frame, the next frame is all in the buffer, or the
+ * pipe has closed. */
+static int detach_ready (detach_t * d)
+{
+  size_t len = 0;
+  int i;
+  if (d->read->inp < d->read->inend || d->eof)
+    return 1;
+  if (d->end - d->frame_end < FRAME_HEADER)
+    return 0;
+  for (i = 0; i < FRAME_HEADER; i++)
+    len |= (size_t) (unsigned char) d->buf[d->frame_end + i] << (8 * i);
+  return d->end - d->frame_end >= FRAME_HEADER + len;
+}
+
+/* Return non-zero if the pipe has closed and everything sent on it
+ * has been received. */
+static int detach_closed (detach_t * d)
+{
+  return d->eof && d->read->inp == d->read->inend && d->end == d->frame_end;
+}
+
+/* Return the next object sent, or NULL if the pipe has closed. */
+static object_t *receive_object (detach_t * d)
+{
+  while (d->read->inp == d->read->inend)
+    if (!next_frame (d))
+      {
+	if (d->end > d->frame_end)
+	  {
+	    /* Throw once, then treat the pipe as closed. */
+	    d->end = d->frame_end;
+	    THROW (detach_pipe_error, c_strs (xstrdup ("truncated frame")));
+	  }
+	return NULL;
+      }
+  return fasl_read (d->read);
+}
+
 object_t *lisp_detach (object_t * lst)
 {
   DOC ("Create process detachment.");
-  REQ (lst, 1, c_sym ("detach"));
+  REQ (lst, 1, sym_detach);
   return c_detach (CAR (lst));
 }
 
 object_t *lisp_receive (object_t * lst)
 {
-  DOC ("Get an object from the detached process.");
-  REQ (lst, 1, c_sym ("receive"));
+  DOC ("Get an object from the detached process, or nil once it has "
+       "exited.");
+  REQ (lst, 1, sym_receive);
   object_t *d = CAR (lst);
   if (!DETACHP (d))
     THROW (wrong_type, UPREF (d));
-  reader_t *r = OREAD (d);
-  return read_sexp (r);
+  object_t *o = receive_object (OVAL (d));
+  return o ? o : NIL;
+}
+
+/* Return the rest of the current or next frame as a list, or NULL if
+ * the pipe has closed. */
+static object_t *receive_list (detach_t * d)
+{
+  object_t *o = receive_object (d);
+  if (o == NULL)
+    return NULL;
+  CHECK (o);
+  object_t *head = c_cons (o, NIL), *tail = head;
+  while (d->read->inp < d->read->inend)
+    {
+      o = fasl_read (d->read);
+      if (o == err_symbol)
+	{
+	  obj_destroy (head);
+	  return err_symbol;
+	}
+      CDR (tail) = c_cons (o, NIL);
+      tail = CDR (tail);
+    }
+  return head;
+}
+
+object_t *lisp_receive_batch (int argc, object_t ** argv)
+{
+  VDOC ("Get the objects from the next send-batch of the detached "
+	"process as a list, or nil once it has exited.");
+  object_t *d = argv[0];
+  if (!DETACHP (d))
+    THROW (wrong_type, UPREF (d));
+  object_t *lst = receive_list (OVAL (d));
+  return lst ? lst : NIL;
+}
+
+/* Milliseconds since an arbitrary point. */
+static double now_ms ()
+{
+  struct timespec ts;
+  clock_gettime (CLOCK_MONOTONIC, &ts);
+  return ts.tv_sec * 1e3 + ts.tv_nsec / 1e6;
+}
+
+object_t *lisp_receive_any (int argc, object_t ** argv)
+{
+  VDOC ("Wait for any detachment in a list to send an object and return "
+	"(detachment . object), or (detachment) once when it has exited. "
+	"Returns nil when all have exited, or after an optional timeout "
+	"in seconds.");
+  object_t *lst = argv[0], *p;
+  double timeout = -1;
+  size_t n = 0, i;
+  for (p = lst; CONSP (p); p = CDR (p), n++)
+    if (!DETACHP (CAR (p)))
+      THROW (wrong_type, UPREF (CAR (p)));
+  if (p != NIL)
+    THROW (wrong_type, UPREF (lst));
+  if (argc > 1 && argv[1] != NIL)
+    {
+      if (!NUMP (argv[1]))
+	THROW (wrong_type, UPREF (argv[1]));
+      timeout = numo2float (argv[1]) * 1e3;
+      if (timeout < 0)
+	timeout = 0;
+    }
+  if (n == 0)
+    return NIL;
+
+  /* Each call starts looking one further along the list, so an early
+   * detachment that always has something can't starve the rest. */
+  static size_t rotate = 0;
+  size_t first = rotate++ % n;
+
+  struct pollfd fds[n];
+  object_t *all[n], *dobs[n];
+  for (i = 0, p = lst; i < n; i++, p = CDR (p))
+    all[i] = CAR (p);
+  double deadline = now_ms () + timeout;
+  while (1)
+    {
+      /* Anything already buffered comes first. Each exit is reported
+       * once, and after that the detachment is skipped. */
+      size_t waiting = 0;
+      for (i = 0; i < n; i++)
+	{
+	  object_t *dob = all[(first + i) % n];
+	  detach_t *d = OVAL (dob);
+	  if (detach_closed (d))
+	    {
+	      if (d->reported)
+		continue;
+	      d->reported = 1;
+	      return c_cons (UPREF (dob), NIL);
+	    }
+	  if (detach_ready (d))
+	    {
+	      object_t *o = receive_object (d);
+	      CHECK (o);
+	      return c_cons (UPREF (dob), o ? o : NIL);
+	    }
+	  fds[waiting].fd = d->in;
+	  fds[waiting].events = POLLIN;
+	  dobs[waiting++] = dob;
+	}
+      if (waiting == 0)
+	return NIL;
+
+      int wait = -1;
+      if (timeout >= 0)
+	{
+	  double left = deadline - now_ms ();
+	  wait = left > 0 ? (int) (left + 0.999) : 0;
+	}
+      int r = poll (fds, waiting, wait);
+      if (r < 0 && errno != EINTR)
+	THROW (detach_pipe_error, c_strs (xstrdup (strerror (errno))));
+      if (r == 0 && wait >= 0 && now_ms () >= deadline)
+	return NIL;
+
+      /* Take whatever has arrived, which may be part of a frame. */
+      for (i = 0; r > 0 && i < waiting; i++)
+	if (fds[i].revents != 0)
+	  detach_fill (OVAL (dobs[i]));
+    }
+}
+
+object_t *lisp_ready_p (int argc, object_t ** argv)
+{
+  VDOC ("Return t if receive from the detachment wouldn't wait.");
+  object_t *dob = argv[0];
+  if (!DETACHP (dob))
+    THROW (wrong_type, UPREF (dob));
+  detach_t *d = OVAL (dob);
+  if (detach_ready (d))
+    return T;
+  struct pollfd fd = { d->in, POLLIN, 0 };
+  while (poll (&fd, 1, 0) > 0 && detach_fill (d))
+    if (detach_ready (d))
+      return T;
+  return detach_ready (d) ? T : NIL;
 }
 
 object_t *lisp_send (object_t * lst)
 {
   DOC ("Send an object to the parent process.");
-  REQ (lst, 1, c_sym ("send"));
+  REQ (lst, 1, sym_send);
   object_t *o = CAR (lst);
   if (parent_detach == NULL || parent_detach == NIL)
-    THROW (c_sym ("send-from-non-detachment"), UPREF (o));
-  obj_print (o, 1);
+    THROW (send_from_non_detachment, UPREF (o));
+  CHECK (send_frame (OVAL (parent_detach), o, NULL));
   return T;
 }
+
+object_t *lisp_send_batch (int argc, object_t ** argv)
+{
+  VDOC ("Send each object in a list to the parent process with a "
+	"single write.");
+  object_t *lst = argv[0];
+  if (parent_detach == NULL || parent_detach == NIL)
+    THROW (send_from_non_detachment, UPREF (lst));
+  if (!LISTP (lst))
+    THROW (wrong_type, UPREF (lst));
+  if (lst == NIL)
+    return T;
+  CHECK (send_frame (OVAL (parent_detach), NULL, lst));
+  return T;
+}
+
+/* Parallel map and reduce */
+
+/* The items one worker handles: first, first + step, ... up to end. */
+typedef struct job
+{
+  object_t *f;
+  object_t **items;
+  size_t first, end, step;
+  int reduce;
+} job_t;
+
+/* Apply f to one or two arguments. */
+static object_t *call (object_t * f, object_t * a, object_t * b)
+{
+  object_t *args = c_cons (UPREF (a), NIL);
+  if (b != NULL)
+    CDR (args) = c_cons (UPREF (b), NIL);
+  object_t *r = apply (f, args);
+  obj_destroy (args);
+  return r;
+}
+
+/* Worker process. It sends t followed by its results, or nil, the
+ * thrown symbol and the attachment if f throws. */
+static void run_job (void *arg)
+{
+  job_t *job = arg;
+  detach_t *d = OVAL (parent_detach);
+  object_t *head = c_cons (T, NIL), *tail = head, *acc = NULL;
+  size_t i;
+  for (i = job->first; i < job->end; i += job->step)
+    {
+      object_t *r;
+      if (!job->reduce)
+	r = call (job->f, job->items[i], NULL);
+      else if (acc == NULL)
+	r = UPREF (job->items[i]);
+      else
+	{
+	  r = call (job->f, acc, job->items[i]);
+	  obj_destroy (acc);
+	}
+      if (r == err_symbol)
+	{
+	  object_t *err = c_cons (NIL, c_cons (err_thrown,
+					       c_cons (err_attach, NIL)));
+	  if (send_frame (d, NULL, err) == err_symbol)
+	    {
+	      /* The attachment can't be sent. */
+	      object_t *slot = CDR (CDR (err));
+	      obj_destroy (err_attach);
+	      obj_destroy (CAR (slot));
+	      CAR (slot) = NIL;
+	      send_frame (d, NULL, err);
+	    }
+	  exit (1);
+	}
+      if (job->reduce)
+	acc = r;
+      else
+	{
+	  CDR (tail) = c_cons (r, NIL);
+	  tail = CDR (tail);
+	}
+    }
+  if (acc != NULL)
+    CDR (tail) = c_cons (acc, NIL);
+  if (send_frame (d, NULL, head) == err_symbol)
+    {
+      object_t *err = c_cons (NIL, c_cons (err_thrown, c_cons (NIL, NIL)));
+      obj_destroy (err_attach);
+      send_frame (d, NULL, err);
+      exit (1);
+    }
+}
+
+/* Run one job per worker and return a vector of each worker's results
+ * list, in order. Workers' errors are thrown once all have finished. */
+static object_t *run_jobs (object_t * f, object_t ** items, size_t n,
+			   size_t workers, int reduce)
+{
+  object_t *procs = c_vec (workers, NIL);
+  object_t *results = c_vec (workers, NIL);
+  size_t k;
+  for (k = 0; k < workers; k++)
+    {
+      job_t job = { f, items, k, n, workers, reduce };
+      if (reduce)
+	{
+	  /* Reducing keeps each worker's items together, so f only
+	   * needs to be associative. */
+	  job.first = k * n / workers;
+	  job.end = (k + 1) * n / workers;
+	  job.step = 1;
+	}
+      object_t *dob = detach_spawn (&run_job, &job);
+      if (dob == err_symbol)
+	break;
+      vset (procs, k, dob);
+    }
+  object_t *thrown = NULL, *attach = NIL;
+  if (k < workers)
+    {
+      thrown = err_thrown;
+      attach = err_attach;
+    }
+
+  /* Collect everything, so no worker is left behind. */
+  for (k = 0; k < workers && OVEC (procs)->v[k] != NIL; k++)
+    {
+      detach_t *d = OVAL (OVEC (procs)->v[k]);
+      object_t *lst = receive_list (d);
+      waitpid (d->proc, NULL, 0);
+      if (thrown != NULL)
+	{
+	  if (lst != NULL && lst != err_symbol)
+	    obj_destroy (lst);
+	  else if (lst == err_symbol)
+	    obj_destroy (err_attach);
+	  continue;
+	}
+      if (lst == NULL)
+	{
+	  thrown = detach_pipe_error;
+	  attach = c_strs (xstrdup ("worker exited early"));
+	}
+      else if (lst == err_symbol)
+	{
+	  thrown = err_thrown;
+	  attach = err_attach;
+	}
+      else if (CAR (lst) == NIL)
+	{
+	  thrown = CAR (CDR (lst));
+	  attach = UPREF (CAR (CDR (CDR (lst))));
+	  obj_destroy (lst);
+	}
+      else
+	{
+	  vset (results, k, UPREF (CDR (lst)));
+	  obj_destroy (lst);
+	}
+    }
+  obj_destroy (procs);
+  if (thrown != NULL)
+    {
+      obj_destroy (results);
+      THROW (thrown, attach);
+    }
+  return results;
+}
+
+/* Put the items of a list or vector in an array, returning the count,
+ * or -1 if seq is neither. */
+static ssize_t seq_items (object_t * seq, object_t *** items)
+{
+  if (VECTORP (seq))
+    {
+      *items = OVEC (seq)->v;
+      return VLENGTH (seq);
+    }
+  if (!LISTP (seq))
+    return -1;
+  size_t n = 0, i;
+  object_t *p;
+  for (p = seq; CONSP (p); p = CDR (p))
+    n++;
+  if (p != NIL)
+    return -1;
+  *items = xmalloc ((n + 1) * sizeof (object_t *));
+  for (i = 0, p = seq; i < n; i++, p = CDR (p))
+    (*items)[i] = CAR (p);
+  return n;
+}
+
+/* Number of workers to use for n items. */
+static size_t worker_count (int argc, object_t ** argv, size_t n)
+{
+  long workers;
+  if (argc > 2 && argv[2] != NIL)
+    workers = into2int (argv[2]);
+  else
+    workers = sysconf (_SC_NPROCESSORS_ONLN);
+  if (workers < 1)
+    workers = 1;
+  if ((size_t) workers > n)
+    workers = n;
+  return workers;
+}
+
+/* Check the arguments shared by pmap and preduce, finding the
+ * function and the items. */
+static object_t *parallel_args (int argc, object_t ** argv, object_t ** f,
+				object_t *** items, ssize_t * n)
+{
+  object_t *fn = argv[0];
+  if (SYMBOLP (fn))
+    fn = GET (fn);
+  if (!FUNCP (fn))
+    THROW (wrong_type, UPREF (argv[0]));
+  if (argc > 2 && argv[2] != NIL && !INTP (argv[2]))
+    THROW (wrong_type, UPREF (argv[2]));
+  if ((*n = seq_items (argv[1], items)) < 0)
+    THROW (wrong_type, UPREF (argv[1]));
+  *f = fn;
+  return T;
+}
+
+object_t *lisp_pmap (int argc, object_t ** argv)
+{
+  VDOC ("Apply a function to each item of a list or vector using "
+	"several worker processes, returning the results in the same "
+	"kind of sequence. The optional third argument is the number of "
+	"workers, by default one per processor.");
+  object_t *f, *seq = argv[1], **items;
+  ssize_t n;
+  CHECK (parallel_args (argc, argv, &f, &items, &n));
+  if (n == 0)
+    {
+      if (!VECTORP (seq))
+	xfree (items);
+      return VECTORP (seq) ? c_vec (0, NIL) : NIL;
+    }
+  size_t workers = worker_count (argc, argv, n);
+  object_t *results = run_jobs (f, items, n, workers, 0);
+  if (!VECTORP (seq))
+    xfree (items);
+  CHECK (results);
+
+  /* Worker k has items k, k + workers, ... */
+  object_t *out = c_vec (n, NIL), *p;
+  size_t k, i;
+  for (k = 0; k < workers; k++)
+    for (i = k, p = OVEC (results)->v[k]; CONSP (p); p = CDR (p))
+      {
+	OVEC (out)->v[i] = UPREF (CAR (p));
+	i += workers;
+      }
+  obj_destroy (results);
+  if (VECTORP (seq))
+    return out;
+  object_t *lst = NIL;
+  for (i = n; i > 0; i--)
+    lst = c_cons (UPREF (OVEC (out)->v[i - 1]), lst);
+  obj_destroy (out);
+  return lst;
+}
+
+object_t *lisp_preduce (int argc, object_t ** argv)
+{
+  VDOC ("Combine the items of a list or vector with an associative "
+	"function of two arguments, splitting the work between several "
+	"worker processes. The optional third argument is the number of "
+	"workers, by default one per processor.");
+  object_t *f, *seq = argv[1], **items;
+  ssize_t n;
+  CHECK (parallel_args (argc, argv, &f, &items, &n));
+  if (n == 0)
+    {
+      if (!VECTORP (seq))
+	xfree (items);
+      return apply (f, NIL);
+    }
+  size_t workers = worker_count (argc, argv, n);
+  object_t *results = run_jobs (f, items, n, workers, 1);
+  if (!VECTORP (seq))
+    xfree (items);
+  CHECK (results);
+
+  /* Each worker reduced its own run of items. */
+  object_t *acc = UPREF (CAR (OVEC (results)->v[0]));
+  size_t k;
+  for (k = 1; k < workers && acc != err_symbol; k++)
+    {
+      object_t *r = call (f, acc, CAR (OVEC (results)->v[k]));
+      obj_destroy (acc);
+      acc = r;
+    }
+  obj_destroy (results);
+  return acc;
+}
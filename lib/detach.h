@@ -3,13 +3,20 @@
 
 #include <unistd.h>
 #include "object.h"
-#include "reader.h"
+#include "fasl.h"
+#include "printer.h"
 
 typedef struct detach
 {
   int in, out;
   pid_t proc;
-  reader_t *read;
+  fasl_reader_t *read;		/* decodes the current frame */
+  fasl_writer_t *write;
+  char *buf;			/* bytes read from in */
+  size_t start, end, size;
+  size_t frame_end;		/* end of the current frame in buf */
+  int eof;			/* the pipe has closed */
+  int reported;			/* receive-any has returned its exit */
 } detach_t;
 
 /* Creation and destruction */
@@ -18,8 +25,8 @@ detach_t *detach_create ();
 void detach_destroy (object_t * o);
 
 /* Basic type functions */
-uint8_t detach_hash (object_t * o);
-void detach_print (object_t * o);
+uint32_t detach_hash (object_t * o);
+void detach_print (printer_t * p, object_t * o);
 
 /* Info on parent process. */
 extern object_t *parent_detach;
@@ -28,9 +35,14 @@ extern object_t *parent_detach;
 object_t *lisp_detach (object_t * lst);
 object_t *lisp_receive (object_t * lst);
 object_t *lisp_send (object_t * lst);
+object_t *lisp_receive_batch (int argc, object_t ** argv);
+object_t *lisp_send_batch (int argc, object_t ** argv);
+object_t *lisp_receive_any (int argc, object_t ** argv);
+object_t *lisp_ready_p (int argc, object_t ** argv);
+object_t *lisp_pmap (int argc, object_t ** argv);
+object_t *lisp_preduce (int argc, object_t ** argv);
 
 #define OPROC(o) (((detach_t *) OVAL (o))->proc);
-#define OREAD(o) (((detach_t *) OVAL (o))->read);
 #define DETACHP(o) (o->type == DETACH)
 
 #endif /* DETACH_H */
@@ -12,19 +12,17 @@
 #include "common.h"
 #include "lisp.h"
 #include "vector.h"
+#include "cycle.h"
+#include "vm.h"
+#include "fasl.h"
 
-object_t *lambda, *macro, *quote;
 object_t *err_symbol, *err_thrown, *err_attach;
-object_t *rest, *optional;
-object_t *doc_string;
-/* Commonly used thrown error symbols */
-object_t *void_function, *wrong_number_of_arguments, *wrong_type,
-  *improper_list, *improper_list_ending, *err_interrupt;
 
 /* Stack counting */
 unsigned int stack_depth = 0, max_stack_depth = 20000;
 
 char *core_file = "core.wisp";
+char *core_image = NULL;
 
 int interrupt = 0;
 int interactive_mode = 0;
@@ -48,24 +46,10 @@ void eval_init ()
   /* install interrupt handler */
   signal (SIGINT, &handle_iterrupt);
 
-  /* regular evaluation symbols */
-  lambda = c_sym ("lambda");
-  macro = c_sym ("macro");
-  quote = c_sym ("quote");
-  rest = c_sym ("&rest");
-  optional = c_sym ("&optional");
-  doc_string = c_sym ("doc-string");
-
-  /* error symbols */
+  /* error symbol, other symbols are in symbols.def */
   err_symbol = c_usym ("wisp-error");
   SET (err_symbol, err_symbol);
   err_thrown = err_attach = NIL;
-  void_function = c_sym ("void-function");
-  wrong_number_of_arguments = c_sym ("wrong-number-of-arguments");
-  wrong_type = c_sym ("wrong-type-argument");
-  improper_list = c_sym ("improper-list");
-  improper_list_ending = c_sym ("improper-list-ending");
-  err_interrupt = c_sym ("caught-interrupt");
 
   /* set up wisproot */
   wisproot = getenv ("WISPROOT");
@@ -73,7 +57,20 @@ void eval_init ()
     wisproot = ".";
   SET (c_sym ("wisproot"), c_strs (xstrdup (wisproot)));
 
-  /* Load core lisp code. */
+  /* Load core lisp code, or a heap image saved after loading it. */
+  if (core_image != NULL)
+    {
+      errno = 0;
+      if (!load_image (core_image))
+	{
+	  fprintf (stderr, "error: could not load image \"%s\"%s%s\n",
+		   core_image, errno ? ": " : "", errno ? strerror (errno) : "");
+	  exit (EXIT_FAILURE);
+	}
+      /* The image has the wisproot it was saved with. */
+      SET (c_sym ("wisproot"), c_strs (xstrdup (wisproot)));
+      return;
+    }
   if (strlen (wisproot) != 0)
     core_file = pathcat (wisproot, core_file);
   int r = load_file (NULL, core_file, 0);
@@ -93,10 +90,10 @@ void wisp_init ()
   /* These *must* be called in this order. */
   object_init ();
   symtab_init ();
-  cons_init ();
   str_init ();
   lisp_init ();
-  vector_init ();
+  vm_init ();
+  fasl_init ();
   eval_init ();
 }
 
@@ -197,10 +194,108 @@ void unassign_args (object_t * vars)
   unassign_args (CDR (vars));
 }
 
+/* Macro expansion */
+
+object_t *macro_expand (object_t * m, object_t * args)
+{
+  object_t *vars = CAR (CDR (m));
+  if (assign_args (vars, args) == err_symbol)
+    {
+      err_attach = UPREF (args);
+      return err_symbol;
+    }
+  object_t *r = eval_body (CDR (CDR (m)));
+  unassign_args (vars);
+  return r;
+}
+
+/* Expansion cache, indexed by the code field of a call site's header
+ * when its expanded bit is set. Entry 0 is unused so that zero means
+ * "not expanded"; free entries are chained through next. */
+typedef struct expansion
+{
+  object_t *macro;		/* macro the form was expanded with */
+  object_t *form;
+  unsigned int next;
+} expansion_t;
+
+static expansion_t *expansions = NULL;
+static unsigned int nexpansions = 1, expansions_size = 0, free_expansion = 0;
+
+static unsigned int expansion_alloc ()
+{
+  unsigned int i;
+  if (free_expansion != 0)
+    {
+      i = free_expansion;
+      free_expansion = expansions[i].next;
+      return i;
+    }
+  if (nexpansions == CODE_MAX)
+    return 0;
+  if (nexpansions >= expansions_size)
+    {
+      expansions_size = expansions_size ? expansions_size * 2 : 256;
+      expansions = xrealloc (expansions,
+			     expansions_size * sizeof (expansion_t));
+    }
+  return nexpansions++;
+}
+
+object_t *macro_expand_form (object_t * m, object_t * form)
+{
+  if (form->code && !form->expanded)
+    return macro_expand (m, CDR (form));	/* index is taken */
+  if (form->code && expansions[form->code].macro == m)
+    return UPREF (expansions[form->code].form);
+
+  object_t *exp = macro_expand (m, CDR (form));
+  CHECK (exp);
+  if (form->code)
+    {
+      /* The macro was redefined since. */
+      expansion_t *e = expansions + form->code;
+      obj_destroy (e->macro);
+      obj_destroy (e->form);
+      e->macro = UPREF (m);
+      e->form = UPREF (exp);
+      return exp;
+    }
+  unsigned int i = expansion_alloc ();
+  if (i == 0)
+    return exp;
+  expansions[i].macro = UPREF (m);
+  expansions[i].form = UPREF (exp);
+  form->code = i;
+  form->expanded = 1;
+  return exp;
+}
+
+void expansion_forget (object_t * form)
+{
+  expansion_t *e = expansions + form->code;
+  object_t *m = e->macro, *exp = e->form;
+  e->next = free_expansion;
+  free_expansion = form->code;
+  form->code = 0;
+  form->expanded = 0;
+  obj_destroy (m);
+  obj_destroy (exp);
+}
+
 object_t *top_eval (object_t * o)
 {
   stack_depth = 0;
-  object_t *r = eval (o);
+  object_t *r;
+  if (GET (lexical_binding) != NIL)
+    {
+      /* Run it as the body of a closure, so it is lexical too. */
+      object_t *f = c_closure (c_cons (NIL, c_cons (UPREF (o), NIL)), NIL);
+      r = apply (f, NIL);
+      obj_destroy (f);
+    }
+  else
+    r = eval (o);
   if (r == err_symbol)
     {
       printf ("Wisp error: ");
@@ -212,6 +307,76 @@ object_t *top_eval (object_t * o)
   return r;
 }
 
+static int vfunc_arity_ok (object_t * f, int argc)
+{
+  return argc >= CFUNC_MIN (f)
+    && (CFUNC_MAX (f) < 0 || argc <= CFUNC_MAX (f));
+}
+
+static object_t *arg_list (int argc, object_t ** argv)
+{
+  object_t *lst = NIL;
+  int i;
+  for (i = argc - 1; i >= 0; i--)
+    lst = c_cons (UPREF (argv[i]), lst);
+  return lst;
+}
+
+object_t *cfunc_call (object_t * f, int argc, object_t ** argv)
+{
+  object_t *lst, *r;
+  if (VFUNCP (f) && vfunc_arity_ok (f, argc))
+    return VFVAL (f) (argc, argv);
+
+  lst = arg_list (argc, argv);
+  if (VFUNCP (f))
+    THROW (wrong_number_of_arguments, c_cons (UPREF (f), lst));
+  r = FVAL (f) (lst);
+  obj_destroy (lst);
+  return r;
+}
+
+/* Arrays of at most this many arguments are kept on the C stack. */
+#define LOCAL_ARGS 8
+
+/* Evaluate the arguments of a call to builtin f into an array. An
+ * arity error names the call by name, the symbol f was found under. */
+static object_t *eval_call (object_t * f, object_t * name, object_t * args)
+{
+  int argc = 0, i;
+  object_t *p;
+  for (p = args; CONSP (p); p = CDR (p))
+    argc++;
+  if (p != NIL)
+    THROW (improper_list_ending, UPREF (p));
+
+  object_t *local[LOCAL_ARGS], **argv = local, *r = NIL;
+  if (argc > LOCAL_ARGS)
+    argv = xmalloc (argc * sizeof (object_t *));
+  for (i = 0, p = args; i < argc; i++, p = CDR (p))
+    {
+      argv[i] = eval (CAR (p));
+      if (argv[i] == err_symbol)
+	{
+	  r = err_symbol;
+	  break;
+	}
+    }
+  if (r != err_symbol && !vfunc_arity_ok (f, argc))
+    {
+      err_thrown = wrong_number_of_arguments;
+      err_attach = c_cons (UPREF (name), arg_list (argc, argv));
+      r = err_symbol;
+    }
+  else if (r != err_symbol)
+    r = cfunc_call (f, argc, argv);
+  while (i > 0)
+    obj_destroy (argv[--i]);
+  if (argv != local)
+    xfree (argv);
+  return r;
+}
+
 object_t *eval (object_t * o)
 {
   /* Check for interrupts. */
@@ -220,6 +385,8 @@ object_t *eval (object_t * o)
       interrupt = 0;
       THROW (err_interrupt, c_strs (xstrdup ("interrupted")));
     }
+  DESTROY_CHECK ();
+  CYCLE_CHECK ();
 
   if (o->type != CONS && o->type != SYMBOL)
     return UPREF (o);
@@ -233,7 +400,7 @@ object_t *eval (object_t * o)
   if (VECTORP (f))
     {
       extrao = o = c_cons (UPREF (f), UPREF (o));
-      f = eval (c_sym ("vfunc"));
+      f = eval (sym_vfunc);
       if (f == err_symbol)
 	{
 	  obj_destroy (extrao);
@@ -248,16 +415,44 @@ object_t *eval (object_t * o)
 
   /* Check the stack */
   if (++stack_depth >= max_stack_depth)
-    THROW (c_sym ("max-eval-depth"), c_int (stack_depth--));
+    THROW (sym_max_eval_depth, c_int (stack_depth--));
+
+  /* Macro calls are expanded once per call site. */
+  if (f->type == CONS && CAR (f) == macro && extrao == NIL)
+    {
+      object_t *exp = macro_expand_form (f, o);
+      obj_destroy (f);
+      object_t *ret = exp;
+      if (exp != err_symbol)
+	{
+	  ret = eval (exp);
+	  obj_destroy (exp);
+	}
+      stack_depth--;
+      return ret;
+    }
+
+  /* Builtins taking an array don't need an argument list. */
+  if (VFUNCP (f))
+    {
+      object_t *name = SYMBOLP (CAR (o)) ? CAR (o) : f;
+      object_t *ret = eval_call (f, name, CDR (o));
+      stack_depth--;
+      obj_destroy (f);
+      obj_destroy (extrao);
+      return ret;
+    }
 
   /* Handle argument list */
   object_t *args = CDR (o);
-  if (f->type == CFUNC || (f->type == CONS && (CAR (f) == lambda)))
+  if (f->type == CFUNC || CLOSUREP (f)
+      || (f->type == CONS && (CAR (f) == lambda)))
     {
       /* c function or list function (eval args) */
       args = eval_list (args);
       if (args == err_symbol)
 	{
+	  stack_depth--;
 	  obj_destroy (f);
 	  obj_destroy (extrao);
 	  return err_symbol;
@@ -276,7 +471,7 @@ object_t *eval (object_t * o)
 
 object_t *apply (object_t * f, object_t * args)
 {
-  if (f->type == CFUNC || f->type == SPECIAL)
+  if (f->type == SPECIAL || (f->type == CFUNC && !VFUNCP (f)))
     {
       /* call the c function */
       cfunc_t cf = FVAL (f);
@@ -285,23 +480,52 @@ object_t *apply (object_t * f, object_t * args)
     }
   else
     {
-      /* list form */
-      object_t *vars = CAR (CDR (f));
+      code_t *c = NULL;
+      if (f->type == CFUNC || ((CLOSUREP (f) || CAR (f) == lambda)
+			       && (c = code_get (f)) != NULL))
+	{
+	  int argc = 0;
+	  object_t *p;
+	  for (p = args; CONSP (p); p = CDR (p))
+	    argc++;
+	  object_t *local[LOCAL_ARGS], **argv = local, *r;
+	  if (argc > LOCAL_ARGS)
+	    argv = xmalloc (argc * sizeof (object_t *));
+	  for (argc = 0, p = args; CONSP (p); p = CDR (p))
+	    argv[argc++] = CAR (p);
+	  if (c == NULL)
+	    r = cfunc_call (f, argc, argv);
+	  else
+	    r = vm_exec (c, argv, argc, CLOSUREP (f) ? CLOSURE_ENV (f) : NIL);
+	  if (argv != local)
+	    xfree (argv);
+	  return r;
+	}
+
+      if (CONSP (f) && CAR (f) == macro)
+	{
+	  object_t *body = macro_expand (f, args);
+	  CHECK (body);
+	  object_t *r = eval (body);
+	  obj_destroy (body);
+	  return r;
+	}
+
+      /* list form, or a closure that couldn't be compiled. That is
+       * fine while it captured nothing, as when it calls itself
+       * during its own compilation, but the tree walker has no way
+       * to see a captured frame. */
+      if (CLOSUREP (f) && CLOSURE_ENV (f) != NIL)
+	THROW (bad_function_form, UPREF (f));
+      object_t *fn = CLOSUREP (f) ? CLOSURE_FN (f) : CDR (f);
+      object_t *vars = CAR (fn);
       object_t *assr = assign_args (vars, args);
       if (assr == err_symbol)
 	{
 	  err_attach = UPREF (args);
 	  return err_symbol;
 	}
-      object_t *r;
-      if (CAR (f) == lambda)
-	r = eval_body (CDR (CDR (f)));
-      else
-	{
-	  object_t *body = eval_body (CDR (CDR (f)));
-	  r = eval (body);
-	  obj_destroy (body);
-	}
+      object_t *r = eval_body (CDR (fn));
       unassign_args (vars);
       return r;
     }
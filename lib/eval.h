@@ -6,10 +6,15 @@
 #include "object.h"
 #include "common.h"
 #include "str.h"
+#include "symtab.h"
 
 /* Initializes everything. */
 void wisp_init ();
 
+/* Heap image to start from instead of loading core.wisp, if set
+ * before wisp_init(). */
+extern char *core_image;
+
 /* Must be called before calling any other functions. */
 void eval_init ();
 
@@ -20,22 +25,31 @@ object_t *assign_args (object_t * vars, object_t * vals);
 void unassign_args (object_t * vars);
 object_t *apply (object_t * f, object_t * rawargs);
 
+/* Call a builtin of either kind on an array of arguments, checking
+ * the arity of those that declare it. */
+object_t *cfunc_call (object_t * f, int argc, object_t ** argv);
+
+/* Expand a call to macro m with the given arguments. */
+object_t *macro_expand (object_t * m, object_t * args);
+
+/* Like macro_expand() on the arguments of form, but the expansion is
+ * kept with the form and reused until the macro is redefined. */
+object_t *macro_expand_form (object_t * m, object_t * form);
+
+/* Called when a form with a cached expansion is freed. */
+void expansion_forget (object_t * form);
+
 extern unsigned int stack_depth, max_stack_depth;
 extern int interactive_mode;
-
-/* Frequently used symbols */
-extern object_t *lambda, *macro, *rest, *optional, *quote;
-extern object_t *doc_string;
+extern int interrupt;
 
 #define FUNCP(o) \
   ((o->type == CONS && CAR(o)->type == SYMBOL \
     && ((CAR(o) == lambda) || (CAR(o) == macro))) \
-   || (o->type == CFUNC) || (o->type == SPECIAL))
+   || (o->type == CFUNC) || (o->type == SPECIAL) || (o->type == CLOSURE))
 
 /* Error handling */
 extern object_t *err_symbol, *err_thrown, *err_attach;
-extern object_t *void_function, *wrong_number_of_arguments, *wrong_type,
-  *improper_list, *improper_list_ending, *err_interrupt;
 
 #define THROW(to, ao) {err_thrown = to; err_attach = ao; return err_symbol;}
 #define CHECK(o) if ((o) == err_symbol) return err_symbol;
@@ -49,5 +63,8 @@ extern object_t *void_function, *wrong_number_of_arguments, *wrong_type,
 #define REQPROP(lst) if (properlistp(lst) == NIL) \
                          THROW (improper_list, lst);
 #define DOC(str) if (lst == doc_string) return c_strs (xstrdup (str));
+/* Builtins of fixed arity don't look at argc, so this uses it. */
+#define VDOC(str) (void) argc; \
+                  if (argv == NULL) return c_strs (xstrdup (str));
 
 #endif /* EVAL_H */
@@ -0,0 +1,972 @@
+/* fasl.c - binary encoding of objects
+ *
+ * Each object starts with a tag byte. Counts and fixnums are LEB128
+ * varints, with signed values zigzag encoded so that small negative
+ * numbers stay short. Flonums are written as their IEEE bits, and
+ * bignums and bigfloats as their GMP limbs, each least significant
+ * byte first. A list is written as its length, its elements and then
+ * its tail, so long lists don't recurse. Builtins are written as the
+ * symbol lisp_init() bound them to.
+ *
+ * Containers are numbered in the order they are first written, the
+ * conses of a list before its elements, and each is registered before
+ * its contents are read back, so a reference to one can appear inside
+ * it. */
+#include <stdio.h>
+#include <string.h>
+#include <errno.h>
+#include <unistd.h>
+#include <sys/stat.h>
+#include <gmp.h>
+#include "common.h"
+#include "object.h"
+#include "symtab.h"
+#include "cons.h"
+#include "str.h"
+#include "number.h"
+#include "vector.h"
+#include "hashtable.h"
+#include "eval.h"
+#include "reader.h"
+#include "fasl.h"
+
+#define FASL_MAGIC "WFASL"
+#define FASL_VERSION 1
+#define FASL_HEADER_LEN 7	/* magic, version, bytes per limb */
+
+/* Bytes read from a file at a time. */
+#define FASL_BLOCK 65536
+
+/* Bigfloat precision allowed no matter how short the input is. */
+#define FASL_MAX_PREC (1 << 24)
+
+enum fasl_tag
+{
+  FASL_SYMBOL = 1,		/* length, name */
+  FASL_USYMBOL,			/* length, name of an uninterned symbol */
+  FASL_SYMREF,			/* index of a symbol already in the stream */
+  FASL_FIXNUM,			/* value */
+  FASL_BIGNUM,			/* signed limb count, limbs */
+  FASL_FLONUM,			/* 8 bytes */
+  FASL_BIGFLOAT,		/* precision, signed size, exponent, limbs */
+  FASL_STRING,			/* length, bytes */
+  FASL_LIST,			/* length, elements, tail */
+  FASL_VECTOR,			/* length, elements */
+  FASL_HASHTABLE,		/* test, count, keys and values */
+  FASL_BUILTIN,			/* symbol */
+  FASL_OBJREF			/* index of a container already written */
+};
+
+#define SHAREDP(o) (CONSP (o) || VECTORP (o) || HASHTABLEP (o))
+
+/* Builtins by the symbol they were first bound to, and back. */
+static object_t *builtin_names, *builtin_values;
+
+static void note_builtin (object_t * sym, void *arg)
+{
+  (void) arg;
+  object_t *f = GET (sym);
+  if (f->type == CFUNC || f->type == SPECIAL)
+    {
+      hashtable_put (builtin_names, UPREF (f), sym);
+      hashtable_put (builtin_values, sym, UPREF (f));
+    }
+}
+
+void fasl_init ()
+{
+  builtin_names = c_hashtable (HASH_EQ, 0);
+  builtin_values = c_hashtable (HASH_EQ, 0);
+  symtab_map (&note_builtin, NULL);
+}
+
+/* Writing */
+
+fasl_writer_t *fasl_writer_create (FILE * fid)
+{
+  fasl_writer_t *w = xmalloc (sizeof (fasl_writer_t));
+  w->fid = fid;
+  w->size = 256;
+  w->len = 0;
+  w->buf = xmalloc (w->size);
+  w->syms = c_hashtable (HASH_EQ, 0);
+  w->nsyms = 0;
+  w->objs = c_hashtable (HASH_EQ, 0);
+  w->nobjs = 0;
+  w->share = 0;
+  w->started = 0;
+  return w;
+}
+
+void fasl_writer_destroy (fasl_writer_t * w)
+{
+  obj_destroy (w->syms);
+  obj_destroy (w->objs);
+  xfree (w->buf);
+  xfree (w);
+}
+
+static void put_bytes (fasl_writer_t * w, void *p, size_t n)
+{
+  if (w->len + n > w->size)
+    {
+      while (w->len + n > w->size)
+	w->size *= 2;
+      w->buf = xrealloc (w->buf, w->size);
+    }
+  memcpy (w->buf + w->len, p, n);
+  w->len += n;
+}
+
+static void put_byte (fasl_writer_t * w, int c)
+{
+  unsigned char b = c;
+  put_bytes (w, &b, 1);
+}
+
+static void put_uint (fasl_writer_t * w, uint64_t n)
+{
+  unsigned char b[10];
+  size_t i = 0;
+  do
+    {
+      b[i] = n & 0x7f;
+      n >>= 7;
+      if (n != 0)
+	b[i] |= 0x80;
+      i++;
+    }
+  while (n != 0);
+  put_bytes (w, b, i);
+}
+
+static void put_int (fasl_writer_t * w, int64_t n)
+{
+  put_uint (w, ((uint64_t) n << 1) ^ (n < 0 ? ~(uint64_t) 0 : 0));
+}
+
+static void put_limbs (fasl_writer_t * w, const mp_limb_t * d, size_t n)
+{
+  size_t i, j;
+  for (i = 0; i < n; i++)
+    for (j = 0; j < sizeof (mp_limb_t); j++)
+      put_byte (w, (d[i] >> (8 * j)) & 0xff);
+}
+
+static void put_symbol (fasl_writer_t * w, object_t * o)
+{
+  object_t *index = hashtable_get (w->syms, o);
+  if (index != NULL)
+    {
+      put_byte (w, FASL_SYMREF);
+      put_uint (w, OFIX (index));
+      return;
+    }
+  hashtable_put (w->syms, o, c_int (w->nsyms++));
+  size_t len = strlen (SYMNAME (o));
+  put_byte (w, INTERNP (o) ? FASL_SYMBOL : FASL_USYMBOL);
+  put_uint (w, len);
+  put_bytes (w, SYMNAME (o), len);
+}
+
+/* Number a container the first time it is written, returning 0 if it
+ * already has a number. Only one pointer leads to a container with a
+ * single reference, so it can't be reached again and isn't looked up
+ * later. */
+static int note_shared (fasl_writer_t * w, object_t * o)
+{
+  if (o->refs == 1)
+    {
+      w->nobjs++;
+      return 1;
+    }
+  if (hashtable_get (w->objs, o) != NULL)
+    return 0;
+  hashtable_put (w->objs, UPREF (o), c_int (w->nobjs++));
+  return 1;
+}
+
+static object_t *put_object (fasl_writer_t * w, object_t * o)
+{
+  object_t *p;
+  size_t i, n;
+  if (SHAREDP (o) && !note_shared (w, o))
+    {
+      put_byte (w, FASL_OBJREF);
+      put_uint (w, OFIX (hashtable_get (w->objs, o)));
+      return T;
+    }
+  switch (o->type)
+    {
+    case SYMBOL:
+      put_symbol (w, o);
+      break;
+    case INT:
+      if (FIXP (o))
+	{
+	  put_byte (w, FASL_FIXNUM);
+	  put_int (w, OFIX (o));
+	  break;
+	}
+      n = mpz_size (DINT (o));
+      put_byte (w, FASL_BIGNUM);
+      put_int (w, mpz_sgn (DINT (o)) < 0 ? -(int64_t) n : (int64_t) n);
+      put_limbs (w, mpz_limbs_read (DINT (o)), n);
+      break;
+    case FLOAT:
+      if (FLONUMP (o))
+	{
+	  uint64_t bits;
+	  memcpy (&bits, &OFLO (o), sizeof (bits));
+	  put_byte (w, FASL_FLONUM);
+	  for (i = 0; i < sizeof (bits); i++)
+	    put_byte (w, (bits >> (8 * i)) & 0xff);
+	  break;
+	}
+      /* There's no public access to a bigfloat's limbs. */
+      mpf_srcptr f = DFLOAT (o);
+      put_byte (w, FASL_BIGFLOAT);
+      put_uint (w, mpf_get_prec (f));
+      put_int (w, f->_mp_size);
+      put_int (w, f->_mp_exp);
+      put_limbs (w, f->_mp_d, f->_mp_size < 0 ? -f->_mp_size : f->_mp_size);
+      break;
+    case STRING:
+      put_byte (w, FASL_STRING);
+      put_uint (w, OSTRLEN (o));
+      put_bytes (w, OSTR (o), OSTRLEN (o));
+      break;
+    case CONS:
+      /* The list ends early at a cons already written, which is
+       * where a circular list comes back around. */
+      for (n = 1, p = CDR (o); CONSP (p) && note_shared (w, p); p = CDR (p))
+	n++;
+      put_byte (w, FASL_LIST);
+      put_uint (w, n);
+      for (i = 0, p = o; i < n; i++, p = CDR (p))
+	CHECK (put_object (w, CAR (p)));
+      return put_object (w, p);
+    case VECTOR:
+      put_byte (w, FASL_VECTOR);
+      put_uint (w, VLENGTH (o));
+      for (i = 0; i < VLENGTH (o); i++)
+	CHECK (put_object (w, OVEC (o)->v[i]));
+      break;
+    case HASHTABLE:
+      put_byte (w, FASL_HASHTABLE);
+      put_byte (w, OHASH (o)->test);
+      put_uint (w, OHASH (o)->count);
+      for (i = 0; i < OHASH (o)->size; i++)
+	if (OHASH (o)->arr[i].key != NULL)
+	  {
+	    CHECK (put_object (w, OHASH (o)->arr[i].key));
+	    CHECK (put_object (w, OHASH (o)->arr[i].value));
+	  }
+      break;
+    case CFUNC:
+    case SPECIAL:
+      p = hashtable_get (builtin_names, o);
+      if (p == NULL)
+	THROW (wrong_type, UPREF (o));
+      put_byte (w, FASL_BUILTIN);
+      put_symbol (w, p);
+      break;
+    default:
+      THROW (wrong_type, UPREF (o));
+    }
+  return T;
+}
+
+/* Remove the entries numbered start or later from a table. */
+static void forget (object_t * table, size_t start)
+{
+  hashtable_t *h = OHASH (table);
+  object_t *lst = NIL;
+  size_t i;
+  for (i = 0; i < h->size; i++)
+    if (h->arr[i].key != NULL && (size_t) OFIX (h->arr[i].value) >= start)
+      lst = c_cons (UPREF (h->arr[i].key), lst);
+  object_t *p;
+  for (p = lst; p != NIL; p = CDR (p))
+    hashtable_remove (table, CAR (p));
+  obj_destroy (lst);
+}
+
+void fasl_rewind (fasl_writer_t * w, size_t len, size_t start)
+{
+  forget (w->syms, start);
+  w->nsyms = start;
+  w->len = len;
+}
+
+/* Forget the containers numbered start or later. */
+static void forget_objs (fasl_writer_t * w, size_t start)
+{
+  w->nobjs = start;
+  if (OHASH (w->objs)->count == 0)
+    return;
+  if (start > 0)
+    forget (w->objs, start);
+  else
+    {
+      obj_destroy (w->objs);
+      w->objs = c_hashtable (HASH_EQ, 0);
+    }
+}
+
+object_t *fasl_write (fasl_writer_t * w, object_t * o)
+{
+  if (!w->started)
+    {
+      put_bytes (w, FASL_MAGIC, strlen (FASL_MAGIC));
+      put_byte (w, FASL_VERSION);
+      put_byte (w, sizeof (mp_limb_t));
+      w->started = 1;
+    }
+  size_t mark = w->len, nsyms = w->nsyms, nobjs = w->nobjs;
+  object_t *r = put_object (w, o);
+  if (!w->share || r == err_symbol)
+    forget_objs (w, nobjs);
+  if (r == err_symbol)
+    {
+      fasl_rewind (w, mark, nsyms);
+      return err_symbol;
+    }
+  if (w->fid != NULL)
+    {
+      if (fwrite (w->buf, 1, w->len, w->fid) != w->len)
+	THROW (fasl_error, c_strs (xstrdup (strerror (errno))));
+      w->len = 0;
+    }
+  return T;
+}
+
+/* Reading */
+
+fasl_reader_t *fasl_reader_create (FILE * fid, char *buf, size_t len,
+				   char *name)
+{
+  fasl_reader_t *r = xmalloc (sizeof (fasl_reader_t));
+  r->fid = fid;
+  r->name = name ? name : "<unknown>";
+  if (fid == NULL)
+    {
+      r->in = NULL;
+      r->inp = buf;
+      r->inend = buf + len;
+      r->rest = 0;
+    }
+  else
+    {
+      r->inp = r->inend = r->in = xmalloc (FASL_BLOCK);
+      /* The size of a regular file is looked up once, so checking
+       * counts against it costs nothing. */
+      struct stat st;
+      off_t pos = lseek (fileno (fid), 0, SEEK_CUR);
+      r->rest = UINT64_MAX;
+      if (pos >= 0 && fstat (fileno (fid), &st) == 0 && S_ISREG (st.st_mode))
+	r->rest = st.st_size > pos ? (uint64_t) (st.st_size - pos) : 0;
+    }
+  r->symsize = 64;
+  r->syms = xmalloc (r->symsize * sizeof (object_t *));
+  r->nsyms = 0;
+  r->objsize = 64;
+  r->objs = xmalloc (r->objsize * sizeof (object_t *));
+  r->nobjs = 0;
+  r->share = 0;
+  r->started = 0;
+  r->eof = 0;
+  return r;
+}
+
+void fasl_reader_destroy (fasl_reader_t * r)
+{
+  while (r->nobjs > 0)
+    obj_destroy (r->objs[--r->nobjs]);
+  xfree (r->in);
+  xfree (r->syms);
+  xfree (r->objs);
+  xfree (r);
+}
+
+/* Read the next block of input, returning 0 at the end. Like the text
+ * reader, this takes whatever a pipe has rather than a full block. */
+static int fasl_fill (fasl_reader_t * r)
+{
+  ssize_t n;
+  if (r->in == NULL)
+    return 0;
+  do
+    n = read (fileno (r->fid), r->in, FASL_BLOCK);
+  while (n < 0 && errno == EINTR);
+  if (n <= 0)
+    return 0;
+  r->inp = r->in;
+  r->inend = r->in + n;
+  if (r->rest != UINT64_MAX)
+    r->rest = (uint64_t) n < r->rest ? r->rest - n : 0;
+  return 1;
+}
+
+static int get_byte (fasl_reader_t * r)
+{
+  if (r->inp == r->inend && !fasl_fill (r))
+    return EOF;
+  return (unsigned char) *(r->inp++);
+}
+
+/* Each of these returns 0 if the input ends first. */
+
+static int get_bytes (fasl_reader_t * r, void *p, size_t n)
+{
+  char *dst = p;
+  while (n > 0)
+    {
+      if (r->inp == r->inend && !fasl_fill (r))
+	return 0;
+      size_t len = r->inend - r->inp;
+      if (len > n)
+	len = n;
+      memcpy (dst, r->inp, len);
+      r->inp += len;
+      dst += len;
+      n -= len;
+    }
+  return 1;
+}
+
+static int get_uint (fasl_reader_t * r, uint64_t * n)
+{
+  int c, shift = 0;
+  *n = 0;
+  do
+    {
+      c = get_byte (r);
+      if (c == EOF || shift > 63)
+	return 0;
+      *n |= (uint64_t) (c & 0x7f) << shift;
+      shift += 7;
+    }
+  while (c & 0x80);
+  return 1;
+}
+
+static int get_int (fasl_reader_t * r, int64_t * n)
+{
+  uint64_t u;
+  if (!get_uint (r, &u))
+    return 0;
+  *n = (int64_t) (u >> 1) ^ -(int64_t) (u & 1);
+  return 1;
+}
+
+static int get_limbs (fasl_reader_t * r, mp_limb_t * d, size_t n)
+{
+  size_t i, j;
+  for (i = 0; i < n; i++)
+    {
+      d[i] = 0;
+      for (j = 0; j < sizeof (mp_limb_t); j++)
+	{
+	  int c = get_byte (r);
+	  if (c == EOF)
+	    return 0;
+	  d[i] |= (mp_limb_t) c << (8 * j);
+	}
+    }
+  return 1;
+}
+
+/* Bytes left in the input, or UINT64_MAX if that can't be known.
+ * Counts read from the input are checked against this before they are
+ * used to allocate, since every element they count takes at least a
+ * byte. */
+static uint64_t fasl_avail (fasl_reader_t * r)
+{
+  uint64_t n = r->inend - r->inp;
+  if (r->in == NULL)
+    return n;
+  return r->rest == UINT64_MAX ? UINT64_MAX : n + r->rest;
+}
+
+/* Error attachment naming the stream and the problem. */
+static object_t *fasl_message (fasl_reader_t * r, char *what)
+{
+  size_t len = strlen (r->name) + strlen (what) + 3;
+  char *msg = xmalloc (len);
+  snprintf (msg, len, "%s: %s", r->name, what);
+  return c_strs (msg);
+}
+
+#define BAD(r, what) THROW (fasl_error, fasl_message (r, what))
+
+/* Number a container before its contents are read. */
+static void get_shared (fasl_reader_t * r, object_t * o)
+{
+  if (r->nobjs == r->objsize)
+    {
+      r->objsize *= 2;
+      r->objs = xrealloc (r->objs, r->objsize * sizeof (object_t *));
+    }
+  r->objs[r->nobjs++] = UPREF (o);
+}
+
+static object_t *get_object (fasl_reader_t * r)
+{
+  object_t *o, *p;
+  uint64_t n, i;
+  int64_t s;
+  int tag = get_byte (r);
+  switch (tag)
+    {
+    case FASL_SYMBOL:
+    case FASL_USYMBOL:
+      if (!get_uint (r, &n))
+	break;
+      if (n > fasl_avail (r))
+	BAD (r, "bad symbol");
+      char *name = xmalloc (n + 1);
+      if (!get_bytes (r, name, n))
+	{
+	  xfree (name);
+	  break;
+	}
+      name[n] = '\0';
+      o = tag == FASL_SYMBOL ? c_sym (name) : c_usym (name);
+      xfree (name);
+      if (r->nsyms == r->symsize)
+	{
+	  r->symsize *= 2;
+	  r->syms = xrealloc (r->syms, r->symsize * sizeof (object_t *));
+	}
+      r->syms[r->nsyms++] = o;
+      return o;
+    case FASL_SYMREF:
+      if (!get_uint (r, &n))
+	break;
+      if (n >= r->nsyms)
+	BAD (r, "bad symbol reference");
+      return r->syms[n];
+    case FASL_FIXNUM:
+      if (!get_int (r, &s))
+	break;
+      return c_int (s);
+    case FASL_BIGNUM:
+      {
+	if (!get_int (r, &s))
+	  break;
+	n = s < 0 ? -(uint64_t) s : (uint64_t) s;
+	if (n > fasl_avail (r) / sizeof (mp_limb_t))
+	  BAD (r, "bad bignum");
+	mpz_t z;
+	mpz_init (z);
+	if (!get_limbs (r, mpz_limbs_write (z, n), n))
+	  {
+	    mpz_clear (z);
+	    break;
+	  }
+	mpz_limbs_finish (z, s);
+	o = c_mpz (z);
+	mpz_clear (z);
+	return o;
+      }
+    case FASL_FLONUM:
+      {
+	uint64_t bits = 0;
+	double d;
+	for (i = 0; i < sizeof (bits); i++)
+	  {
+	    int c = get_byte (r);
+	    if (c == EOF)
+	      break;
+	    bits |= (uint64_t) c << (8 * i);
+	  }
+	if (i < sizeof (bits))
+	  break;
+	memcpy (&d, &bits, sizeof (d));
+	return c_float (d);
+      }
+    case FASL_BIGFLOAT:
+      {
+	int64_t exp;
+	if (!get_uint (r, &n) || !get_int (r, &s) || !get_int (r, &exp))
+	  break;
+	uint64_t limbs = s < 0 ? -(uint64_t) s : (uint64_t) s;
+	uint64_t avail = fasl_avail (r) / sizeof (mp_limb_t);
+	if (n == 0 || limbs > avail
+	    || (n > FASL_MAX_PREC && n / GMP_NUMB_BITS > avail))
+	  BAD (r, "bad bigfloat");
+	mpf_t f;
+	mpf_init2 (f, n);
+	n = limbs;
+	if (n > (uint64_t) f->_mp_prec + 1)
+	  {
+	    mpf_clear (f);
+	    BAD (r, "bad bigfloat");
+	  }
+	if (!get_limbs (r, f->_mp_d, n))
+	  {
+	    mpf_clear (f);
+	    break;
+	  }
+	f->_mp_size = s;
+	f->_mp_exp = exp;
+	o = c_mpf (f);
+	mpf_clear (f);
+	return o;
+      }
+    case FASL_STRING:
+      {
+	if (!get_uint (r, &n))
+	  break;
+	if (n > fasl_avail (r))
+	  BAD (r, "bad string");
+	char *str = xmalloc (n + 1);
+	if (!get_bytes (r, str, n))
+	  {
+	    xfree (str);
+	    break;
+	  }
+	str[n] = '\0';
+	return c_str (str, n);
+      }
+    case FASL_LIST:
+      {
+	if (!get_uint (r, &n))
+	  break;
+	if (n == 0 || n > fasl_avail (r))
+	  BAD (r, "bad list");
+	/* The conses are all numbered before the elements. */
+	object_t *head = c_cons (NIL, NIL), *tail = head;
+	for (i = 0; i < n; i++)
+	  {
+	    CDR (tail) = c_cons (NIL, NIL);
+	    tail = CDR (tail);
+	    get_shared (r, tail);
+	  }
+	o = CDR (head);
+	CDR (head) = NIL;
+	obj_destroy (head);
+	for (i = 0, p = o; i <= n; i++)
+	  {
+	    object_t *elem = get_object (r);
+	    if (elem == err_symbol)
+	      {
+		obj_destroy (o);
+		return err_symbol;
+	      }
+	    if (i == n)
+	      CDR (tail) = elem;
+	    else
+	      {
+		CAR (p) = elem;
+		p = CDR (p);
+	      }
+	  }
+	return o;
+      }
+    case FASL_VECTOR:
+      if (!get_uint (r, &n))
+	break;
+      if (n > fasl_avail (r))
+	BAD (r, "bad vector");
+      o = c_vec (n, NIL);
+      get_shared (r, o);
+      for (i = 0; i < n; i++)
+	{
+	  p = get_object (r);
+	  if (p == err_symbol)
+	    {
+	      obj_destroy (o);
+	      return err_symbol;
+	    }
+	  OVEC (o)->v[i] = p;
+	}
+      return o;
+    case FASL_HASHTABLE:
+      {
+	int test = get_byte (r);
+	if (test == EOF || !get_uint (r, &n))
+	  break;
+	if (test > HASH_EQUAL)
+	  BAD (r, "bad hash table test");
+	if (n > fasl_avail (r))
+	  BAD (r, "bad hash table");
+	o = c_hashtable (test, n);
+	get_shared (r, o);
+	for (i = 0; i < n; i++)
+	  {
+	    object_t *key = get_object (r), *value = err_symbol;
+	    if (key != err_symbol)
+	      value = get_object (r);
+	    if (value == err_symbol)
+	      {
+		if (key != err_symbol)
+		  obj_destroy (key);
+		obj_destroy (o);
+		return err_symbol;
+	      }
+	    hashtable_put (o, key, value);
+	  }
+	return o;
+      }
+    case FASL_OBJREF:
+      if (!get_uint (r, &n))
+	break;
+      if (n >= r->nobjs)
+	BAD (r, "bad object reference");
+      return UPREF (r->objs[n]);
+    case FASL_BUILTIN:
+      p = get_object (r);
+      CHECK (p);
+      if (!SYMBOLP (p) || (o = hashtable_get (builtin_values, p)) == NULL)
+	BAD (r, "unknown builtin");
+      return UPREF (o);
+    case EOF:
+      break;
+    default:
+      BAD (r, "unknown tag");
+    }
+  BAD (r, "unexpected end of input");
+}
+
+object_t *fasl_read (fasl_reader_t * r)
+{
+  if (r->inp == r->inend && !fasl_fill (r))
+    {
+      r->eof = 1;
+      return NIL;
+    }
+  if (!r->started)
+    {
+      unsigned char header[FASL_HEADER_LEN];
+      if (!get_bytes (r, header, FASL_HEADER_LEN)
+	  || memcmp (header, FASL_MAGIC, strlen (FASL_MAGIC)) != 0)
+	BAD (r, "not a fasl stream");
+      if (header[5] != FASL_VERSION)
+	BAD (r, "unsupported fasl version");
+      if (header[6] != sizeof (mp_limb_t))
+	BAD (r, "written with a different GMP limb size");
+      r->started = 1;
+      return fasl_read (r);
+    }
+  size_t nobjs = r->nobjs;
+  object_t *o = get_object (r);
+  if (!r->share || o == err_symbol)
+    while (r->nobjs > nobjs)
+      obj_destroy (r->objs[--r->nobjs]);
+  return o;
+}
+
+/* Files */
+
+char *fasl_name (char *filename)
+{
+  size_t len = strlen (filename);
+  if (len < 5 || strcmp (filename + len - 5, ".wisp") != 0)
+    return NULL;
+  char *name = xmalloc (len + 2);
+  memcpy (name, filename, len - 5);
+  strcpy (name + len - 5, ".wfasl");
+  return name;
+}
+
+int fasl_fresh (char *filename, char *faslname)
+{
+  struct stat src, fasl;
+  if (stat (faslname, &fasl) != 0)
+    return 0;
+  if (stat (filename, &src) != 0)
+    return 1;
+  if (fasl.st_mtim.tv_sec != src.st_mtim.tv_sec)
+    return fasl.st_mtim.tv_sec > src.st_mtim.tv_sec;
+  return fasl.st_mtim.tv_nsec >= src.st_mtim.tv_nsec;
+}
+
+int load_fasl (char *filename)
+{
+  FILE *fid = fopen (filename, "r");
+  if (fid == NULL)
+    return 0;
+  fasl_reader_t *r = fasl_reader_create (fid, NULL, 0, filename);
+  /* Each file starts out dynamically scoped. */
+  sympush (lexical_binding, NIL);
+  while (1)
+    {
+      object_t *sexp = fasl_read (r);
+      if (r->eof)
+	break;
+      if (sexp == err_symbol)
+	{
+	  fprintf (stderr, "%s\n", OSTR (err_attach));
+	  obj_destroy (err_attach);
+	  break;
+	}
+      obj_destroy (top_eval (sexp));
+      obj_destroy (sexp);
+    }
+  sympop (lexical_binding);
+  fasl_reader_destroy (r);
+  fclose (fid);
+  return 1;
+}
+
+/* Heap images */
+
+static void dump_symbol (object_t * sym, void *arg)
+{
+  fasl_writer_t *w = arg;
+  object_t *o = GET (sym);
+  if (o == NIL || o == sym || hashtable_get (builtin_values, sym) == o)
+    return;
+  object_t *pair = c_cons (sym, UPREF (o));
+  if (fasl_write (w, pair) == err_symbol)
+    {
+      fprintf (stderr, "warning: not saving the value of %s\n",
+	       SYMNAME (sym));
+      obj_destroy (err_attach);
+    }
+  obj_destroy (pair);
+}
+
+int dump_image (char *filename)
+{
+  FILE *fid = fopen (filename, "w");
+  if (fid == NULL)
+    return 0;
+  fasl_writer_t *w = fasl_writer_create (fid);
+  w->share = 1;
+  symtab_map (&dump_symbol, w);
+  fasl_writer_destroy (w);
+  return fclose (fid) == 0;
+}
+
+int load_image (char *filename)
+{
+  FILE *fid = fopen (filename, "r");
+  if (fid == NULL)
+    return 0;
+  fasl_reader_t *r = fasl_reader_create (fid, NULL, 0, filename);
+  r->share = 1;
+  int ok = 1;
+  while (ok)
+    {
+      object_t *pair = fasl_read (r);
+      if (r->eof)
+	break;
+      if (pair == err_symbol)
+	{
+	  fprintf (stderr, "%s\n", OSTR (err_attach));
+	  obj_destroy (err_attach);
+	  ok = 0;
+	}
+      else if (!CONSP (pair) || !SYMBOLP (CAR (pair)))
+	{
+	  fprintf (stderr, "%s: not a heap image\n", filename);
+	  obj_destroy (pair);
+	  ok = 0;
+	}
+      else
+	{
+	  SET (CAR (pair), CDR (pair));
+	  obj_destroy (pair);
+	}
+    }
+  fasl_reader_destroy (r);
+  fclose (fid);
+  return ok;
+}
+
+/* lisp-space functions */
+
+object_t *lisp_write_binary (int argc, object_t ** argv)
+{
+  VDOC ("Return a string holding the binary encoding of an object.");
+  fasl_writer_t *w = fasl_writer_create (NULL);
+  object_t *r = fasl_write (w, argv[0]);
+  if (r != err_symbol)
+    {
+      char *str = xmalloc (w->len + 1);
+      memcpy (str, w->buf, w->len);
+      str[w->len] = '\0';
+      r = c_str (str, w->len);
+    }
+  fasl_writer_destroy (w);
+  return r;
+}
+
+object_t *lisp_read_binary (int argc, object_t ** argv)
+{
+  VDOC ("Decode an object from a string made by write-binary.");
+  object_t *str = argv[0];
+  if (!STRINGP (str))
+    THROW (wrong_type, UPREF (str));
+  fasl_reader_t *r =
+    fasl_reader_create (NULL, OSTR (str), OSTRLEN (str), "read-binary");
+  object_t *o = fasl_read (r);
+  int eof = r->eof;
+  fasl_reader_destroy (r);
+  if (eof)
+    THROW (fasl_error, UPREF (str));
+  return o;
+}
+
+object_t *lisp_fasl_file (int argc, object_t ** argv)
+{
+  VDOC ("Write the forms in a .wisp file to a .wfasl file beside it, "
+	"which load uses instead while it isn't older than the source.");
+  object_t *src = argv[0];
+  if (!STRINGP (src))
+    THROW (wrong_type, UPREF (src));
+  char *out = fasl_name (OSTR (src));
+  if (out == NULL)
+    THROW (wrong_type, UPREF (src));
+  FILE *in = fopen (OSTR (src), "r");
+  if (in == NULL)
+    {
+      xfree (out);
+      THROW (load_file_error, UPREF (src));
+    }
+  FILE *fout = fopen (out, "w");
+  if (fout == NULL)
+    {
+      fclose (in);
+      THROW (fasl_error, c_strs (out));
+    }
+
+  /* Forms are written out as they are read. */
+  reader_t *r = reader_create (in, NULL, OSTR (src), 0);
+  fasl_writer_t *w = fasl_writer_create (fout);
+  object_t *ret = T;
+  while (ret != err_symbol)
+    {
+      object_t *sexp = read_sexp (r);
+      if (sexp == err_symbol)
+	{
+	  err_thrown = parse_error;
+	  err_attach = UPREF (src);
+	  ret = err_symbol;
+	  break;
+	}
+      if (r->eof && sexp == NIL)
+	break;
+      ret = fasl_write (w, sexp);
+      obj_destroy (sexp);
+    }
+  fasl_writer_destroy (w);
+  reader_destroy (r);
+  fclose (in);
+  if (fclose (fout) != 0 && ret != err_symbol)
+    {
+      err_thrown = fasl_error;
+      err_attach = c_strs (xstrdup (strerror (errno)));
+      ret = err_symbol;
+    }
+  if (ret == err_symbol)
+    {
+      remove (out);
+      xfree (out);
+      return err_symbol;
+    }
+  return c_strs (out);
+}
@@ -0,0 +1,94 @@
+/* fasl.h - binary encoding of objects */
+#ifndef FASL_H
+#define FASL_H
+
+#include <stdio.h>
+#include "object.h"
+
+/* Must be called after lisp_init(), so the builtins can be found. */
+void fasl_init ();
+
+/* A fasl stream starts with a header and is followed by any number of
+ * objects. Symbols are written by name the first time they appear in
+ * a stream and by index after that, so both ends keep a table of the
+ * symbols seen so far for as long as the stream is open. Conses,
+ * vectors and hash tables are likewise written out once per object
+ * and by index after that, which keeps shared structure and lets
+ * cyclic objects be written at all. With share set at both ends, they
+ * are remembered for the whole stream instead, so structure shared
+ * between separate objects is kept too. */
+
+/* Writes objects to a file, or collects them in memory when fid is
+ * NULL. */
+typedef struct fasl_writer
+{
+  FILE *fid;
+  char *buf;			/* encoded but not yet written out */
+  size_t len, size;
+  object_t *syms;		/* eq hash table of symbol to index */
+  size_t nsyms;
+  object_t *objs;		/* eq hash table of container to index */
+  size_t nobjs;
+  int share;			/* keep objs between objects */
+  int started;			/* header has been written */
+} fasl_writer_t;
+
+/* Reads objects from a file, or from a block of memory when fid is
+ * NULL. */
+typedef struct fasl_reader
+{
+  FILE *fid;
+  char *name;
+  char *in, *inp, *inend;
+  uint64_t rest;		/* file bytes not yet read, if known */
+  object_t **syms;
+  size_t nsyms, symsize;
+  object_t **objs;		/* containers, with references */
+  size_t nobjs, objsize;
+  int share;			/* keep objs between objects */
+  int started, eof;
+} fasl_reader_t;
+
+fasl_writer_t *fasl_writer_create (FILE * fid);
+void fasl_writer_destroy (fasl_writer_t * w);
+
+/* Encode an object, writing it out if the writer has a file. Returns
+ * T, or err_symbol for objects that have no encoding. */
+object_t *fasl_write (fasl_writer_t * w, object_t * o);
+
+/* Drop what was encoded after the writer held len bytes and nsyms
+ * symbols, as if it had never been written. */
+void fasl_rewind (fasl_writer_t * w, size_t len, size_t nsyms);
+
+fasl_reader_t *fasl_reader_create (FILE * fid, char *buf, size_t len,
+				   char *name);
+void fasl_reader_destroy (fasl_reader_t * r);
+
+/* Decode the next object. At the end of the stream this sets eof and
+ * returns NIL. Bad input returns err_symbol. */
+object_t *fasl_read (fasl_reader_t * r);
+
+/* Return the fasl file name for a source file, from xmalloc(), or
+ * NULL if it isn't a .wisp file. */
+char *fasl_name (char *filename);
+
+/* Return non-zero if the fasl file exists and isn't older than the
+ * source file. */
+int fasl_fresh (char *filename, char *faslname);
+
+/* Evaluate each object in a fasl file, like load_file(). */
+int load_fasl (char *filename);
+
+/* A heap image is a fasl file of (symbol . value) pairs holding every
+ * global variable other than builtins and nil, written as one shared
+ * stream so values keep their identity. Values that can't be encoded,
+ * such as closures, are left out with a warning. */
+int dump_image (char *filename);
+int load_image (char *filename);
+
+/* lisp-space functions */
+object_t *lisp_write_binary (int argc, object_t ** argv);
+object_t *lisp_read_binary (int argc, object_t ** argv);
+object_t *lisp_fasl_file (int argc, object_t ** argv);
+
+#endif /* FASL_H */
@@ -1,4 +1,4 @@
-/* hashtab.c - simple hashtable */
+/* hashtab.c - open addressing hashtable */
 
 #include <stdlib.h>
 #include <string.h>
@@ -6,19 +6,33 @@
 #include "common.h"
 #include "hashtab.h"
 
-hashtab_t *ht_init (size_t size, int (*hash_func) (void *, size_t, size_t))
+/* Smallest table that will be allocated. */
+#define HT_MIN 8
+
+static size_t ht_round (size_t size)
+{
+  size_t n = HT_MIN;
+  while (n < size)
+    n *= 2;
+  return n;
+}
+
+static hashtab_node_t *ht_alloc (size_t size)
+{
+  hashtab_node_t *arr = xmalloc (sizeof (hashtab_node_t) * size);
+  size_t i;
+  for (i = 0; i < size; i++)
+    arr[i].key = NULL;
+  return arr;
+}
+
+hashtab_t *ht_init (size_t size, uint32_t (*hash_func) (void *, size_t))
 {
   hashtab_t *new_ht = (hashtab_t *) xmalloc (sizeof (hashtab_t));
-  new_ht->arr =
-    (hashtab_node_t **) xmalloc (sizeof (hashtab_node_t *) * size);
-  new_ht->size = size;
+  new_ht->size = ht_round (size);
+  new_ht->arr = ht_alloc (new_ht->size);
   new_ht->count = 0;
 
-  /* all entries are empty */
-  int i = 0;
-  for (i = 0; i < (int) size; i++)
-    new_ht->arr[i] = NULL;
-
   if (hash_func == NULL)
     new_ht->hash_func = &ht_hash;
   else
@@ -27,136 +41,131 @@ hashtab_t *ht_init (size_t size, int (*hash_func) (void *, size_t, size_t))
   return new_ht;
 }
 
+/* How far the slot at index is from where its hash would put it. */
+static size_t ht_dist (hashtab_t * hashtable, uint32_t hash, size_t index)
+{
+  return (index - hash) & (hashtable->size - 1);
+}
+
+/* Return the slot holding the key, or NULL. */
+static hashtab_node_t *ht_find (hashtab_t * hashtable, void *key,
+				size_t keylen, uint32_t hash)
+{
+  size_t mask = hashtable->size - 1, index = hash & mask, dist = 0;
+  while (1)
+    {
+      hashtab_node_t *node = &hashtable->arr[index];
+      if (node->key == NULL || ht_dist (hashtable, node->hash, index) < dist)
+	return NULL;
+      if (node->hash == hash && node->keylen == keylen
+	  && memcmp (key, node->key, keylen) == 0)
+	return node;
+      index = (index + 1) & mask;
+      dist++;
+    }
+}
+
 void *ht_search (hashtab_t * hashtable, void *key, size_t keylen)
 {
-  int index = ht_hash (key, keylen, hashtable->size);
-  if (hashtable->arr[index] == NULL)
+  uint32_t hash = hashtable->hash_func (key, keylen);
+  hashtab_node_t *node = ht_find (hashtable, key, keylen, hash);
+  if (node == NULL)
     return NULL;
+  return node->value;
+}
 
-  hashtab_node_t *last_node = hashtable->arr[index];
-  while (last_node != NULL)
+/* Place a node known not to be in the table, moving richer entries
+ * further along. */
+static void ht_place (hashtab_t * hashtable, hashtab_node_t node)
+{
+  size_t mask = hashtable->size - 1, index = node.hash & mask, dist = 0;
+  while (hashtable->arr[index].key != NULL)
     {
-      if (last_node->keylen == keylen)
-	if (memcmp (key, last_node->key, keylen) == 0)
-	  return last_node->value;
-      last_node = last_node->next;
+      hashtab_node_t *slot = &hashtable->arr[index];
+      size_t slot_dist = ht_dist (hashtable, slot->hash, index);
+      if (slot_dist < dist)
+	{
+	  hashtab_node_t tmp = *slot;
+	  *slot = node;
+	  node = tmp;
+	  dist = slot_dist;
+	}
+      index = (index + 1) & mask;
+      dist++;
     }
-  return NULL;
+  hashtable->arr[index] = node;
+}
+
+static void ht_resize (hashtab_t * hashtable, size_t new_size)
+{
+  hashtab_node_t *old = hashtable->arr;
+  size_t i, old_size = hashtable->size;
+  hashtable->size = new_size;
+  hashtable->arr = ht_alloc (new_size);
+  for (i = 0; i < old_size; i++)
+    if (old[i].key != NULL)
+      ht_place (hashtable, old[i]);
+  xfree (old);
 }
 
 void *ht_insert (hashtab_t * hashtable,
 		 void *key, size_t keylen, void *value, size_t vallen)
 {
-  int index = ht_hash (key, keylen, hashtable->size);
-
-  hashtab_node_t *next_node, *last_node;
-  next_node = hashtable->arr[index];
-  last_node = NULL;
+  uint32_t hash = hashtable->hash_func (key, keylen);
 
   /* Search for an existing key. */
-  while (next_node != NULL)
+  hashtab_node_t *node = ht_find (hashtable, key, keylen, hash);
+  if (node != NULL)
     {
-      if (next_node->keylen == keylen)
-	{
-	  if (memcmp (key, next_node->key, keylen) == 0)
-	    {
-	      next_node->value = value;
-	      next_node->vallen = vallen;
-	      return next_node->value;
-	    }
-	}
-      last_node = next_node;
-      next_node = next_node->next;
+      node->value = value;
+      node->vallen = vallen;
+      return value;
     }
 
-  /* create a new node */
-  hashtab_node_t *new_node;
-  new_node = (hashtab_node_t *) xmalloc (sizeof (hashtab_node_t));
-  new_node->key = key;
-  new_node->value = value;
-  new_node->keylen = keylen;
-  new_node->vallen = vallen;
-  new_node->next = NULL;
-
-  /* Tack the new node on the end or right on the table. */
-  if (last_node != NULL)
-    last_node->next = new_node;
-  else
-    hashtable->arr[index] = new_node;
-
+  if (((size_t) hashtable->count + 1) * 8 > hashtable->size * HT_LOAD)
+    ht_resize (hashtable, hashtable->size * 2);
+  hashtab_node_t new_node = { key, keylen, value, vallen, hash };
+  ht_place (hashtable, new_node);
   hashtable->count++;
-  return new_node->value;
+  return value;
 }
 
 /* delete the given key from the hashtable */
 void ht_remove (hashtab_t * hashtable, void *key, size_t keylen)
 {
-  hashtab_node_t *last_node, *next_node;
-  int index = ht_hash (key, keylen, hashtable->size);
-  next_node = hashtable->arr[index];
-  last_node = NULL;
-
-  while (next_node != NULL)
+  uint32_t hash = hashtable->hash_func (key, keylen);
+  hashtab_node_t *node = ht_find (hashtable, key, keylen, hash);
+  if (node == NULL)
+    return;
+
+  /* Shift the following entries back instead of leaving a marker. */
+  size_t mask = hashtable->size - 1, index = node - hashtable->arr;
+  size_t next = (index + 1) & mask;
+  while (hashtable->arr[next].key != NULL
+	 && ht_dist (hashtable, hashtable->arr[next].hash, next) > 0)
     {
-      if (next_node->keylen == keylen)
-	{
-	  if (memcmp (key, next_node->key, keylen) == 0)
-	    {
-	      /* adjust the list pointers */
-	      if (last_node != NULL)
-		last_node->next = next_node->next;
-	      else
-		hashtable->arr[index] = next_node->next;
-
-	      /* free the node */
-	      xfree (next_node);
-	      break;
-	    }
-	}
-      last_node = next_node;
-      next_node = next_node->next;
+      hashtable->arr[index] = hashtable->arr[next];
+      index = next;
+      next = (next + 1) & mask;
     }
+  hashtable->arr[index].key = NULL;
+  hashtable->count--;
 }
 
-/* grow the hashtable */
-hashtab_t *ht_grow (hashtab_t * old_ht, size_t new_size)
+/* resize the hashtable */
+hashtab_t *ht_grow (hashtab_t * hashtable, size_t new_size)
 {
-  /* create new hashtable */
-  hashtab_t *new_ht = ht_init (new_size, old_ht->hash_func);
-  if (new_ht == NULL)
-    return NULL;
-
-  /* Iterate through the old hashtable. */
-  hashtab_iter_t ii;
-  ht_iter_init (old_ht, &ii);
-  for (; ii.key != NULL; ht_iter_inc (&ii))
-    ht_insert (new_ht, ii.key, ii.keylen, ii.value, ii.vallen);
-
-  /* Destroy the old hashtable. */
-  ht_destroy (old_ht);
-
-  return new_ht;
+  new_size = ht_round (new_size);
+  while ((size_t) hashtable->count * 8 > new_size * HT_LOAD)
+    new_size *= 2;
+  if (new_size != hashtable->size)
+    ht_resize (hashtable, new_size);
+  return hashtable;
 }
 
 /* free all resources used by the hashtable */
 void ht_destroy (hashtab_t * hashtable)
 {
-  hashtab_node_t *next_node, *last_node;
-
-  /* Free each linked list in hashtable. */
-  int i;
-  for (i = 0; i < (int) hashtable->size; i++)
-    {
-      next_node = hashtable->arr[i];
-      while (next_node != NULL)
-	{
-	  /* destroy node */
-	  last_node = next_node;
-	  next_node = next_node->next;
-	  xfree (last_node);
-	}
-    }
-
   xfree (hashtable->arr);
   xfree (hashtable);
 }
@@ -166,7 +175,6 @@ void ht_iter_init (hashtab_t * hashtable, hashtab_iter_t * ii)
 {
   /* stick in initial bookeeping data */
   ii->internal.hashtable = hashtable;
-  ii->internal.node = NULL;
   ii->internal.index = -1;
 
   /* have iterator point to first element */
@@ -177,32 +185,16 @@ void ht_iter_init (hashtab_t * hashtable, hashtab_iter_t * ii)
 void ht_iter_inc (hashtab_iter_t * ii)
 {
   hashtab_t *hashtable = ii->internal.hashtable;
-  int index = ii->internal.index;
-
-  /* attempt to grab the next node */
-  if (ii->internal.node == NULL || ii->internal.node->next == NULL)
-    index++;
-  else
-    {
-      /* next node in the list */
-      ii->internal.node = ii->internal.node->next;
-      ii->key = ii->internal.node->key;
-      ii->value = ii->internal.node->value;
-      ii->keylen = ii->internal.node->keylen;
-      ii->vallen = ii->internal.node->vallen;
-      return;
-    }
+  int index = ii->internal.index + 1;
 
   /* find next node */
-  while (hashtable->arr[index] == NULL && index < (int) hashtable->size)
+  while (index < (int) hashtable->size && hashtable->arr[index].key == NULL)
     index++;
+  ii->internal.index = index;
 
   if (index >= (int) hashtable->size)
     {
       /* end of hashtable */
-      ii->internal.node = NULL;
-      ii->internal.index = (int) hashtable->size;
-
       ii->key = NULL;
       ii->value = NULL;
       ii->keylen = 0;
@@ -211,26 +203,14 @@ void ht_iter_inc (hashtab_iter_t * ii)
     }
 
   /* point to the next item in the hashtable */
-  ii->internal.node = hashtable->arr[index];
-  ii->internal.index = index;
-  ii->key = ii->internal.node->key;
-  ii->value = ii->internal.node->value;
-  ii->keylen = ii->internal.node->keylen;
-  ii->vallen = ii->internal.node->vallen;
+  hashtab_node_t *node = &hashtable->arr[index];
+  ii->key = node->key;
+  ii->value = node->value;
+  ii->keylen = node->keylen;
+  ii->vallen = node->vallen;
 }
 
-int ht_hash (void *key, size_t keylen, size_t hashtab_size)
+uint32_t ht_hash (void *key, size_t keylen)
 {
-  /* One-at-a-time hash */
-  uint32_t hash, i;
-  for (hash = 0, i = 0; i < keylen; ++i)
-    {
-      hash += ((char *) key)[i];
-      hash += (hash << 10);
-      hash ^= (hash >> 6);
-    }
-  hash += (hash << 3);
-  hash ^= (hash >> 11);
-  hash += (hash << 15);
-  return (hash % hashtab_size);
+  return mem_hash (key, keylen);
 }
@@ -3,23 +3,28 @@
 #define HASHTAB_H
 
 #include <stdlib.h>
+#include <stdint.h>
 
+/* One slot of the table. Keys are not copied, so they must stay valid
+ * while they are in the table. */
 typedef struct hashtab_node_t
 {
-  void *key;			/* key for the node */
+  void *key;			/* key for the node, NULL if empty */
   size_t keylen;		/* length of the key */
   void *value;			/* value for this node */
   size_t vallen;		/* length of the value */
-
-  struct hashtab_node_t *next;	/* next node (open hashtable) */
+  uint32_t hash;		/* full hash of the key */
 } hashtab_node_t;
 
+/* Open addressing with Robin Hood probing: an entry is never further
+ * from its home slot than the entry it would displace, which keeps
+ * probe sequences short even at high load. */
 typedef struct hashtab_t
 {
-  hashtab_node_t **arr;
-  size_t size;			/* size of the hash */
+  hashtab_node_t *arr;
+  size_t size;			/* number of slots, a power of two */
   int count;			/* number if items in this table */
-  int (*hash_func) (void *, size_t, size_t);	/* hash function */
+  uint32_t (*hash_func) (void *, size_t);	/* hash function */
 } hashtab_t;
 
 /* Iterator type for iterating through the hashtable. */
@@ -35,27 +40,29 @@ typedef struct hashtab_iter_t
   struct hashtab_internal_t
   {
     hashtab_t *hashtable;
-    hashtab_node_t *node;
     int index;
   } internal;
 
 } hashtab_iter_t;
 
+/* The table grows when it is more than this many eighths full. */
+#define HT_LOAD 7
+
 /* Initialize a new hashtable (set bookingkeeping data) and return a
- * pointer to the hashtable. A hash function may be provided. If no
+ * pointer to the hashtable. The size is rounded up to a power of two,
+ * and the table grows by itself as items are added. A hash function
+ * may be provided, which must return the full hash of the key. If no
  * function pointer is given (a NULL pointer), then the built in hash
- * function is used. A NULL pointer returned if the creation of the
- * hashtable failed due to a failed malloc(). */
-hashtab_t *ht_init (size_t size,
-		    int (*hash_func)
-		    (void *key, size_t keylen, size_t ht_size));
+ * function is used. */
+hashtab_t *ht_init (size_t size, uint32_t (*hash_func) (void *key,
+							 size_t keylen));
 
 /* Fetch a value from table matching the key. Returns a pointer to
  * the value matching the given key. */
 void *ht_search (hashtab_t * hashtable, void *key, size_t keylen);
 
-/* Put a value into the table with the given key. Returns NULL if
- * malloc() fails to allocate memory for the new node. */
+/* Put a value into the table with the given key, replacing the value
+ * of an existing key. Returns the value. */
 void *ht_insert (hashtab_t * hashtable,
 		 void *key, size_t keylen, void *value, size_t vallen);
 
@@ -63,19 +70,16 @@ void *ht_insert (hashtab_t * hashtable,
  * does not exist, no error is given. */
 void ht_remove (hashtab_t * hashtable, void *key, size_t keylen);
 
-/* Change the size of the hashtable. It will allocate a new hashtable
- * and move all keys and values over. The pointer to the new hashtable
- * is returned. Will return NULL if the new hashtable fails to be
- * allocated. If this happens, the old hashtable will not be altered
- * in any way. The old hashtable is destroyed upon a successful
- * grow. */
+/* Change the size of the hashtable, which is never made smaller than
+ * its items need. Returns the hashtable, which is the same pointer. */
 hashtab_t *ht_grow (hashtab_t * hashtable, size_t new_size);
 
 /* Free all resources used by the hashtable. */
 void ht_destroy (hashtab_t * hashtable);
 
 /* Initialize the given iterator. It will point to the first element
- * in the hashtable. */
+ * in the hashtable. Items must not be added or removed while
+ * iterating. */
 void ht_iter_init (hashtab_t * hashtable, hashtab_iter_t * ii);
 
 /* Increment the iterator to the next element. The iterator key and
@@ -84,6 +88,6 @@ void ht_iter_init (hashtab_t * hashtable, hashtab_iter_t * ii);
 void ht_iter_inc (hashtab_iter_t * ii);
 
 /* Default hashtable hash function. */
-int ht_hash (void *key, size_t key_size, size_t hashtab_size);
+uint32_t ht_hash (void *key, size_t key_size);
 
 #endif
@@ -0,0 +1,267 @@
+/* hashtable.c - hash tables of lisp objects */
+#include <stdio.h>
+#include <string.h>
+#include "common.h"
+#include "object.h"
+#include "symtab.h"
+#include "cons.h"
+#include "str.h"
+#include "number.h"
+#include "hashtable.h"
+
+/* From lisp_math.c */
+object_t *num_eq (int argc, object_t ** argv);
+
+/* Smallest table that will be allocated. */
+#define HASHTABLE_MIN 8
+
+/* The table grows when it is more than this many eighths full. */
+#define HASHTABLE_LOAD 7
+
+static hashtable_entry_t *hashtable_alloc (size_t size)
+{
+  hashtable_entry_t *arr = xmalloc (sizeof (hashtable_entry_t) * size);
+  size_t i;
+  for (i = 0; i < size; i++)
+    arr[i].key = NULL;
+  return arr;
+}
+
+hashtable_t *hashtable_create ()
+{
+  hashtable_t *h = xmalloc (sizeof (hashtable_t));
+  h->size = HASHTABLE_MIN;
+  h->arr = hashtable_alloc (h->size);
+  h->count = 0;
+  h->test = HASH_EQL;
+  return h;
+}
+
+object_t *c_hashtable (hash_test_t test, size_t size)
+{
+  object_t *o = obj_create (HASHTABLE);
+  hashtable_t *h = OHASH (o);
+  h->test = test;
+  if (size * 8 > h->size * HASHTABLE_LOAD)
+    {
+      while (size * 8 > h->size * HASHTABLE_LOAD)
+	h->size *= 2;
+      xfree (h->arr);
+      h->arr = hashtable_alloc (h->size);
+    }
+  return o;
+}
+
+void hashtable_destroy (object_t * o)
+{
+  hashtable_t *h = OHASH (o);
+  size_t i;
+  for (i = 0; i < h->size; i++)
+    if (h->arr[i].key != NULL)
+      {
+	obj_destroy (h->arr[i].key);
+	obj_destroy (h->arr[i].value);
+      }
+  xfree (h->arr);
+  h->arr = NULL;
+  h->size = h->count = 0;
+}
+
+/* Hash of key consistent with the table's test. Objects only equal to
+ * themselves hash by identity, so mutating them doesn't lose them.
+ * Lists are bounded the same way as in obj_hash(). */
+static uint32_t key_hash (hash_test_t test, object_t * o, int depth)
+{
+  if (test == HASH_EQ)
+    return word_hash ((uintptr_t) o);
+  switch (o->type)
+    {
+    case INT:
+    case FLOAT:
+    case STRING:
+      return obj_hash (o);
+    case CONS:
+      if (test == HASH_EQUAL)
+	{
+	  uint32_t h = CONS;
+	  int n;
+	  if (depth >= HASH_DEPTH)
+	    return h;
+	  for (n = 0; CONSP (o) && n < HASH_LENGTH; n++, o = CDR (o))
+	    h = hash_combine (h, key_hash (test, CAR (o), depth + 1));
+	  if (!CONSP (o))
+	    h = hash_combine (h, key_hash (test, o, depth + 1));
+	  return h;
+	}
+      break;
+    default:
+      break;
+    }
+  return word_hash ((uintptr_t) o);
+}
+
+/* Compare keys the way eq, eql and equal do, except that every object
+ * is the same key as itself. */
+static int key_equal (hash_test_t test, object_t * a, object_t * b)
+{
+  if (a == b)
+    return 1;
+  if (test == HASH_EQ || a->type != b->type)
+    return 0;
+  switch (a->type)
+    {
+    case INT:
+      if (FIXP (a) && FIXP (b))
+	return OFIX (a) == OFIX (b);
+      break;
+    case FLOAT:
+      if (FLONUMP (a) && FLONUMP (b))
+	return OFLO (a) == OFLO (b);
+      break;
+    case STRING:
+      return OSTRLEN (a) == OSTRLEN (b)
+	&& memcmp (OSTR (a), OSTR (b), OSTRLEN (a)) == 0;
+    case CONS:
+      if (test != HASH_EQUAL)
+	return 0;
+      while (CONSP (a) && CONSP (b))
+	{
+	  if (!key_equal (test, CAR (a), CAR (b)))
+	    return 0;
+	  a = CDR (a);
+	  b = CDR (b);
+	}
+      return key_equal (test, a, b);
+    default:
+      return 0;
+    }
+  object_t *argv[2] = { a, b };
+  return num_eq (2, argv) == T;
+}
+
+/* How far the slot at index is from where its hash would put it. */
+static size_t hashtable_dist (hashtable_t * h, uint32_t hash, size_t index)
+{
+  return (index - hash) & (h->size - 1);
+}
+
+/* Return the slot holding the key, or NULL. */
+static hashtable_entry_t *hashtable_find (hashtable_t * h, object_t * key,
+					  uint32_t hash)
+{
+  size_t mask = h->size - 1, index = hash & mask, dist = 0;
+  while (1)
+    {
+      hashtable_entry_t *e = &h->arr[index];
+      if (e->key == NULL || hashtable_dist (h, e->hash, index) < dist)
+	return NULL;
+      if (e->hash == hash && key_equal (h->test, key, e->key))
+	return e;
+      index = (index + 1) & mask;
+      dist++;
+    }
+}
+
+/* Place an entry known not to be in the table, moving richer entries
+ * further along. */
+static void hashtable_place (hashtable_t * h, hashtable_entry_t e)
+{
+  size_t mask = h->size - 1, index = e.hash & mask, dist = 0;
+  while (h->arr[index].key != NULL)
+    {
+      hashtable_entry_t *slot = &h->arr[index];
+      size_t slot_dist = hashtable_dist (h, slot->hash, index);
+      if (slot_dist < dist)
+	{
+	  hashtable_entry_t tmp = *slot;
+	  *slot = e;
+	  e = tmp;
+	  dist = slot_dist;
+	}
+      index = (index + 1) & mask;
+      dist++;
+    }
+  h->arr[index] = e;
+}
+
+static void hashtable_resize (hashtable_t * h, size_t new_size)
+{
+  hashtable_entry_t *old = h->arr;
+  size_t i, old_size = h->size;
+  h->size = new_size;
+  h->arr = hashtable_alloc (new_size);
+  for (i = 0; i < old_size; i++)
+    if (old[i].key != NULL)
+      hashtable_place (h, old[i]);
+  xfree (old);
+}
+
+object_t *hashtable_get (object_t * o, object_t * key)
+{
+  hashtable_t *h = OHASH (o);
+  uint32_t hash = key_hash (h->test, key, 0);
+  hashtable_entry_t *e = hashtable_find (h, key, hash);
+  if (e == NULL)
+    return NULL;
+  return e->value;
+}
+
+void hashtable_put (object_t * o, object_t * key, object_t * value)
+{
+  hashtable_t *h = OHASH (o);
+  uint32_t hash = key_hash (h->test, key, 0);
+  hashtable_entry_t *e = hashtable_find (h, key, hash);
+  if (e != NULL)
+    {
+      /* Keep the original key. */
+      object_t *old = e->value;
+      e->value = value;
+      obj_destroy (old);
+      obj_destroy (key);
+      return;
+    }
+
+  if ((h->count + 1) * 8 > h->size * HASHTABLE_LOAD)
+    hashtable_resize (h, h->size * 2);
+  hashtable_entry_t new_entry = { key, value, hash };
+  hashtable_place (h, new_entry);
+  h->count++;
+}
+
+int hashtable_remove (object_t * o, object_t * key)
+{
+  hashtable_t *h = OHASH (o);
+  uint32_t hash = key_hash (h->test, key, 0);
+  hashtable_entry_t *e = hashtable_find (h, key, hash);
+  if (e == NULL)
+    return 0;
+  object_t *oldkey = e->key, *oldval = e->value;
+
+  /* Shift the following entries back instead of leaving a marker. */
+  size_t mask = h->size - 1, index = e - h->arr;
+  size_t next = (index + 1) & mask;
+  while (h->arr[next].key != NULL
+	 && hashtable_dist (h, h->arr[next].hash, next) > 0)
+    {
+      h->arr[index] = h->arr[next];
+      index = next;
+      next = (next + 1) & mask;
+    }
+  h->arr[index].key = NULL;
+  h->count--;
+
+  /* Release last, since that may run arbitrary destruction. */
+  obj_destroy (oldkey);
+  obj_destroy (oldval);
+  return 1;
+}
+
+void hashtable_print (printer_t * p, object_t * o)
+{
+  static char *test_names[] = { "eq", "eql", "equal" };
+  hashtable_t *h = OHASH (o);
+  char buf[64];
+  snprintf (buf, sizeof (buf), "<hash-table %s %zu>",
+	    test_names[h->test], h->count);
+  printer_puts (p, buf);
+}
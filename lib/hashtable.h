@@ -0,0 +1,50 @@
+/* hashtable.h - hash tables of lisp objects */
+#ifndef HASHTABLE_H
+#define HASHTABLE_H
+
+#include <stdint.h>
+#include "object.h"
+#include "printer.h"
+
+/* How keys are compared, named after the lisp predicates. */
+typedef enum hash_test
+{ HASH_EQ, HASH_EQL, HASH_EQUAL } hash_test_t;
+
+/* One slot of the table. The table holds a reference to each key and
+ * value. */
+typedef struct hashtable_entry
+{
+  object_t *key;		/* NULL if empty */
+  object_t *value;
+  uint32_t hash;
+} hashtable_entry_t;
+
+/* Open addressing with Robin Hood probing, as in hashtab.c. */
+typedef struct hashtable
+{
+  hashtable_entry_t *arr;
+  size_t size;			/* number of slots, a power of two */
+  size_t count;
+  hash_test_t test;
+} hashtable_t;
+
+/* Creation and destruction */
+object_t *c_hashtable (hash_test_t test, size_t size);
+hashtable_t *hashtable_create ();
+void hashtable_destroy (object_t * o);
+
+/* Return the value stored under key, or NULL, without a reference. */
+object_t *hashtable_get (object_t * o, object_t * key);
+
+/* Store value under key, taking the caller's references to both. */
+void hashtable_put (object_t * o, object_t * key, object_t * value);
+
+/* Remove key, returning 0 if it wasn't there. */
+int hashtable_remove (object_t * o, object_t * key);
+
+void hashtable_print (printer_t * p, object_t * o);
+
+#define HASHTABLEP(o) ((o)->type == HASHTABLE)
+#define OHASH(o) ((hashtable_t *) OVAL (o))
+
+#endif /* HASHTABLE_H */
@@ -12,17 +12,23 @@
 #include "number.h"
 #include "vector.h"
 #include "detach.h"
+#include "hashtable.h"
+#include "mem.h"
+#include "cycle.h"
+#include "fasl.h"
+#include "printer.h"
+#include "port.h"
 
 /* From lisp_math.c */
 void lisp_math_init ();
-object_t *num_eq (object_t * lst);
+object_t *num_eq (int argc, object_t ** argv);
 
 /* Various basic stuff */
 
 object_t *cdoc_string (object_t * lst)
 {
   DOC ("Return doc-string for CFUNC or SPECIAL.");
-  REQ (lst, 1, c_sym ("cdoc-string"));
+  REQ (lst, 1, sym_cdoc_string);
   object_t *fo = CAR (lst);
   int evaled = 0;
   if (SYMBOLP (fo))
@@ -36,8 +42,11 @@ object_t *cdoc_string (object_t * lst)
 	obj_destroy (fo);
       THROW (wrong_type, UPREF (fo));
     }
-  cfunc_t f = FVAL (fo);
-  object_t *str = f (doc_string);
+  object_t *str;
+  if (VFUNCP (fo))
+    str = VFVAL (fo) (0, NULL);
+  else
+    str = FVAL (fo) (doc_string);
   if (evaled)
     obj_destroy (fo);
   return str;
@@ -46,7 +55,7 @@ object_t *cdoc_string (object_t * lst)
 object_t *lisp_apply (object_t * lst)
 {
   DOC ("Apply function to a list.");
-  REQ (lst, 2, c_sym ("apply"));
+  REQ (lst, 2, sym_apply);
   object_t *f = CAR (lst);
   object_t *args = CAR (CDR (lst));
   if (!LISTP (args))
@@ -89,17 +98,16 @@ object_t *lisp_or (object_t * lst)
   return NIL;
 }
 
-object_t *lisp_cons (object_t * lst)
+object_t *lisp_cons (int argc, object_t ** argv)
 {
-  DOC ("Construct a new cons cell, given car and cdr.");
-  REQ (lst, 2, c_sym ("cons"));
-  return c_cons (UPREF (CAR (lst)), UPREF (CAR (CDR (lst))));
+  VDOC ("Construct a new cons cell, given car and cdr.");
+  return c_cons (UPREF (argv[0]), UPREF (argv[1]));
 }
 
 object_t *lisp_quote (object_t * lst)
 {
   DOC ("Return argument unevaluated.");
-  REQ (lst, 1, c_sym ("quote"));
+  REQ (lst, 1, quote);
   return UPREF (CAR (lst));
 }
 
@@ -107,7 +115,9 @@ object_t *lambda_f (object_t * lst)
 {
   DOC ("Create an anonymous function.");
   if (!is_func_form (lst))
-    THROW (c_sym ("bad-function-form"), UPREF (lst));
+    THROW (bad_function_form, UPREF (lst));
+  if (GET (lexical_binding) != NIL)
+    return c_closure (c_cons (UPREF (CAR (lst)), UPREF (CDR (lst))), NIL);
   return c_cons (lambda, UPREF (lst));
 }
 
@@ -115,8 +125,8 @@ object_t *defun (object_t * lst)
 {
   DOC ("Define a new function.");
   if (!SYMBOLP (CAR (lst)) || !is_func_form (CDR (lst)))
-    THROW (c_sym ("bad-function-form"), UPREF (lst));
-  object_t *f = c_cons (lambda, UPREF (CDR (lst)));
+    THROW (bad_function_form, UPREF (lst));
+  object_t *f = lambda_f (CDR (lst));
   SET (CAR (lst), f);
   return UPREF (CAR (lst));
 }
@@ -125,32 +135,30 @@ object_t *defmacro (object_t * lst)
 {
   DOC ("Define a new macro.");
   if (!SYMBOLP (CAR (lst)) || !is_func_form (CDR (lst)))
-    THROW (c_sym ("bad-function-form"), UPREF (lst));
+    THROW (bad_function_form, UPREF (lst));
   object_t *f = c_cons (macro, UPREF (CDR (lst)));
   SET (CAR (lst), f);
   return UPREF (CAR (lst));
 }
 
-object_t *lisp_cdr (object_t * lst)
+object_t *lisp_cdr (int argc, object_t ** argv)
 {
-  DOC ("Return cdr element of cons cell.");
-  REQ (lst, 1, c_sym ("cdr"));
-  if (CAR (lst) == NIL)
+  VDOC ("Return cdr element of cons cell.");
+  if (argv[0] == NIL)
     return NIL;
-  if (!LISTP (CAR (lst)))
-    THROW (wrong_type, CAR (lst));
-  return UPREF (CDR (CAR (lst)));
+  if (!LISTP (argv[0]))
+    THROW (wrong_type, UPREF (argv[0]));
+  return UPREF (CDR (argv[0]));
 }
 
-object_t *lisp_car (object_t * lst)
+object_t *lisp_car (int argc, object_t ** argv)
 {
-  DOC ("Return car element of cons cell.");
-  REQ (lst, 1, c_sym ("car"));
-  if (CAR (lst) == NIL)
+  VDOC ("Return car element of cons cell.");
+  if (argv[0] == NIL)
     return NIL;
-  if (!LISTP (CAR (lst)))
-    THROW (wrong_type, CAR (lst));
-  return UPREF (CAR (CAR (lst)));
+  if (!LISTP (argv[0]))
+    THROW (wrong_type, UPREF (argv[0]));
+  return UPREF (CAR (argv[0]));
 }
 
 object_t *lisp_list (object_t * lst)
@@ -190,7 +198,7 @@ object_t *lisp_cond (object_t * lst)
       if (CDR (pair) == NIL)
 	return UPREF (CAR (pair));
       if (CDR (CDR (pair)) != NIL)
-	THROW (c_sym ("bad-form"), UPREF (pair));
+	THROW (bad_form, UPREF (pair));
       object_t *r = eval (CAR (pair));
       if (r != NIL)
 	{
@@ -214,15 +222,15 @@ object_t *let (object_t * lst)
        "body in that scope.");
   /* verify structure */
   if (!LISTP (CAR (lst)))
-    THROW (c_sym ("bad-let-form"), UPREF (lst));
+    THROW (bad_let_form, UPREF (lst));
   object_t *vlist = CAR (lst);
   while (vlist != NIL)
     {
       object_t *p = CAR (vlist);
       if (!LISTP (p))
-	THROW (c_sym ("bad-let-form"), UPREF (lst));
+	THROW (bad_let_form, UPREF (lst));
       if (!SYMBOLP (CAR (p)))
-	THROW (c_sym ("bad-let-form"), UPREF (lst));
+	THROW (bad_let_form, UPREF (lst));
       vlist = CDR (vlist);
     }
 
@@ -264,7 +272,7 @@ object_t *let (object_t * lst)
 object_t *lisp_while (object_t * lst)
 {
   DOC ("Continually evaluate body until first argument evals nil.");
-  REQM (lst, 1, c_sym ("while"));
+  REQM (lst, 1, sym_while);
   object_t *r = NIL, *cond = CAR (lst), *body = CDR (lst);
   object_t *condr;
   while ((condr = eval (cond)) != NIL)
@@ -277,32 +285,162 @@ object_t *lisp_while (object_t * lst)
   return r;
 }
 
+/* Macros */
+
+/* Return the macro called by form, or NULL. */
+static object_t *form_macro (object_t * form)
+{
+  if (!CONSP (form) || !SYMBOLP (CAR (form)))
+    return NULL;
+  object_t *m = GET (CAR (form));
+  if (m->type == CONS && CAR (m) == macro)
+    return m;
+  return NULL;
+}
+
+/* Expand form until it is no longer a macro call. */
+static object_t *expand (object_t * form)
+{
+  object_t *m;
+  (void) UPREF (form);
+  while ((m = form_macro (form)) != NULL)
+    {
+      (void) UPREF (m);
+      object_t *exp = macro_expand (m, CDR (form));
+      obj_destroy (m);
+      obj_destroy (form);
+      CHECK (exp);
+      form = exp;
+    }
+  return form;
+}
+
+static object_t *expand_all (object_t * form);
+
+/* Expand every form in a list but the first skip. */
+static object_t *expand_list (object_t * lst, int skip)
+{
+  if (!CONSP (lst))
+    return UPREF (lst);
+  object_t *car = skip > 0 ? UPREF (CAR (lst)) : expand_all (CAR (lst));
+  CHECK (car);
+  object_t *cdr = expand_list (CDR (lst), skip - 1);
+  if (cdr == err_symbol)
+    {
+      obj_destroy (car);
+      return err_symbol;
+    }
+  return c_cons (car, cdr);
+}
+
+/* Apply expand_list() to each list in a list, as in cond clauses and
+ * let bindings. */
+static object_t *expand_each (object_t * lst, int skip)
+{
+  if (!CONSP (lst))
+    return UPREF (lst);
+  object_t *car = expand_list (CAR (lst), skip);
+  CHECK (car);
+  object_t *cdr = expand_each (CDR (lst), skip);
+  if (cdr == err_symbol)
+    {
+      obj_destroy (car);
+      return err_symbol;
+    }
+  return c_cons (car, cdr);
+}
+
+static object_t *expand_all (object_t * form)
+{
+  object_t *exp = expand (form);
+  CHECK (exp);
+  if (!CONSP (exp))
+    return exp;
+
+  /* Special forms whose arguments aren't all forms */
+  object_t *head = CAR (exp), *r;
+  object_t *f = SYMBOLP (head) ? GET (head) : NIL;
+  cfunc_t sp = f->type == SPECIAL ? FVAL (f) : NULL;
+  if (sp == &lisp_quote)
+    return exp;
+  else if (sp == &lambda_f)
+    r = expand_list (exp, 2);
+  else if (sp == &defun || sp == &defmacro)
+    r = expand_list (exp, 3);
+  else if (sp == &lisp_cond)
+    {
+      r = expand_each (CDR (exp), 0);
+      if (r != err_symbol)
+	r = c_cons (UPREF (head), r);
+    }
+  else if (sp == &let && CONSP (CDR (exp)))
+    {
+      object_t *body = expand_list (CDR (CDR (exp)), 0);
+      r = body;
+      if (body != err_symbol)
+	{
+	  r = expand_each (CAR (CDR (exp)), 1);
+	  if (r == err_symbol)
+	    obj_destroy (body);
+	  else
+	    r = c_cons (UPREF (head), c_cons (r, body));
+	}
+    }
+  else
+    r = expand_list (exp, SYMBOLP (head) ? 1 : 0);
+  obj_destroy (exp);
+  return r;
+}
+
+object_t *lisp_macroexpand_1 (object_t * lst)
+{
+  DOC ("Expand form once if it is a macro call.");
+  REQ (lst, 1, sym_macroexpand_1);
+  object_t *form = CAR (lst), *m = form_macro (form);
+  if (m == NULL)
+    return UPREF (form);
+  (void) UPREF (m);
+  object_t *r = macro_expand (m, CDR (form));
+  obj_destroy (m);
+  return r;
+}
+
+object_t *lisp_macroexpand (object_t * lst)
+{
+  DOC ("Expand form until it is no longer a macro call.");
+  REQ (lst, 1, sym_macroexpand);
+  return expand (CAR (lst));
+}
+
+object_t *lisp_macroexpand_all (object_t * lst)
+{
+  DOC ("Expand all macro calls in form and its subforms.");
+  REQ (lst, 1, sym_macroexpand_all);
+  return expand_all (CAR (lst));
+}
+
 /* Equality */
 
-object_t *eq (object_t * lst)
+object_t *eq (int argc, object_t ** argv)
 {
-  DOC ("Return t if both arguments are the same lisp object.");
-  REQ (lst, 2, c_sym ("eq"));
-  object_t *a = CAR (lst);
-  object_t *b = CAR (CDR (lst));
-  if (a == b)
+  VDOC ("Return t if both arguments are the same lisp object.");
+  if (argv[0] == argv[1])
     return T;
   return NIL;
 }
 
-object_t *eql (object_t * lst)
+object_t *eql (int argc, object_t ** argv)
 {
-  DOC ("Return t if both arguments are similar.");
-  REQ (lst, 2, c_sym ("eql"));
-  object_t *a = CAR (lst);
-  object_t *b = CAR (CDR (lst));
+  VDOC ("Return t if both arguments are similar.");
+  object_t *a = argv[0];
+  object_t *b = argv[1];
   if (a->type != b->type)
     return NIL;
   switch (a->type)
     {
     case INT:
     case FLOAT:
-      return num_eq (lst);
+      return num_eq (argc, argv);
       break;
     case SYMBOL:
     case CONS:
@@ -318,6 +456,9 @@ object_t *eql (object_t * lst)
       return NIL;
       break;
     case DETACH:
+    case HASHTABLE:
+    case CLOSURE:
+    case PORT:
       if (a == b)
 	return T;
       break;
@@ -330,63 +471,68 @@ object_t *eql (object_t * lst)
   return NIL;
 }
 
-object_t *lisp_hash (object_t * lst)
+object_t *lisp_hash (int argc, object_t ** argv)
 {
-  DOC ("Return integer hash of object.");
-  REQ (lst, 1, c_sym ("hash"));
-  return c_int (obj_hash (CAR (lst)));
+  VDOC ("Return integer hash of object.");
+  return c_int (obj_hash (argv[0]));
 }
 
 object_t *lisp_print (object_t * lst)
 {
   DOC ("Print object or sexp in parse-able form.");
-  REQ (lst, 1, c_sym ("print"));
+  REQ (lst, 1, sym_print);
   obj_print (CAR (lst), 1);
   return NIL;
 }
 
+object_t *lisp_prin1_to_string (int argc, object_t ** argv)
+{
+  VDOC ("Return the printed form of object as a string.");
+  printer_t *p = printer_create (NULL, -1);
+  obj_write (p, argv[0]);
+  object_t *str = printer_string (p);
+  printer_destroy (p);
+  return str;
+}
+
 /* Symbol table */
 
-object_t *lisp_set (object_t * lst)
+object_t *lisp_set (int argc, object_t ** argv)
 {
-  DOC ("Store object in symbol.");
-  REQ (lst, 2, c_sym ("set"));
-  if (!SYMBOLP (CAR (lst)))
-    THROW (wrong_type, c_cons (c_sym ("set"), CAR (lst)));
-  if (CONSTANTP (CAR (lst)))
-    THROW (c_sym ("setting-constant"), CAR (lst));
-
-  SET (CAR (lst), CAR (CDR (lst)));
-  return UPREF (CAR (CDR (lst)));
+  VDOC ("Store object in symbol.");
+  if (!SYMBOLP (argv[0]))
+    THROW (wrong_type, c_cons (sym_set, UPREF (argv[0])));
+  if (CONSTANTP (argv[0]))
+    THROW (setting_constant, argv[0]);
+
+  SET (argv[0], argv[1]);
+  return UPREF (argv[1]);
 }
 
-object_t *lisp_value (object_t * lst)
+object_t *lisp_value (int argc, object_t ** argv)
 {
-  DOC ("Get value stored in symbol.");
-  REQ (lst, 1, c_sym ("value"));
-  if (!SYMBOLP (CAR (lst)))
-    THROW (wrong_type, c_cons (c_sym ("value"), CAR (lst)));
+  VDOC ("Get value stored in symbol.");
+  if (!SYMBOLP (argv[0]))
+    THROW (wrong_type, c_cons (sym_value, UPREF (argv[0])));
 
-  return UPREF (GET (CAR (lst)));
+  return UPREF (GET (argv[0]));
 }
 
-object_t *symbol_name (object_t * lst)
+object_t *symbol_name (int argc, object_t ** argv)
 {
-  DOC ("Return symbol name as string.");
-  REQ (lst, 1, c_sym ("symbol-name"));
-  if (!SYMBOLP (CAR (lst)))
-    THROW (wrong_type, UPREF (CAR (lst)));
-  return c_strs (xstrdup (SYMNAME (CAR (lst))));
+  VDOC ("Return symbol name as string.");
+  if (!SYMBOLP (argv[0]))
+    THROW (wrong_type, UPREF (argv[0]));
+  return c_strs (xstrdup (SYMNAME (argv[0])));
 }
 
 /* String */
 
-object_t *lisp_concat (object_t * lst)
+object_t *lisp_concat (int argc, object_t ** argv)
 {
-  DOC ("Concatenate two strings.");
-  REQ (lst, 2, c_sym ("concat"));
-  object_t *a = CAR (lst);
-  object_t *b = CAR (CDR (lst));
+  VDOC ("Concatenate two strings.");
+  object_t *a = argv[0];
+  object_t *b = argv[1];
   if (!STRINGP (a))
     THROW (wrong_type, UPREF (a));
   if (!STRINGP (b))
@@ -396,107 +542,132 @@ object_t *lisp_concat (object_t * lst)
 
 /* Predicates */
 
-object_t *nullp (object_t * lst)
+object_t *nullp (int argc, object_t ** argv)
 {
-  DOC ("Return t if object is nil.");
-  REQ (lst, 1, c_sym ("nullp"));
-  if (CAR (lst) == NIL)
+  VDOC ("Return t if object is nil.");
+  if (argv[0] == NIL)
     return T;
   return NIL;
 }
 
-object_t *funcp (object_t * lst)
+object_t *funcp (int argc, object_t ** argv)
 {
-  DOC ("Return t if object is a function.");
-  REQ (lst, 1, c_sym ("funcp"));
-  if (FUNCP (CAR (lst)))
+  VDOC ("Return t if object is a function.");
+  if (FUNCP (argv[0]))
     return T;
   return NIL;
 }
 
-object_t *listp (object_t * lst)
+object_t *listp (int argc, object_t ** argv)
 {
-  DOC ("Return t if object is a list.");
-  REQ (lst, 1, c_sym ("listp"));
-  if (LISTP (CAR (lst)))
+  VDOC ("Return t if object is a list.");
+  if (LISTP (argv[0]))
     return T;
   return NIL;
 }
 
-object_t *symbolp (object_t * lst)
+object_t *symbolp (int argc, object_t ** argv)
 {
-  DOC ("Return t if object is a symbol.");
-  REQ (lst, 1, c_sym ("symbolp"));
-  if (SYMBOLP (CAR (lst)))
+  VDOC ("Return t if object is a symbol.");
+  if (SYMBOLP (argv[0]))
     return T;
   return NIL;
 }
 
-object_t *numberp (object_t * lst)
+object_t *numberp (int argc, object_t ** argv)
 {
-  DOC ("Return t if object is a number.");
-  REQ (lst, 1, c_sym ("numberp"));
-  if (NUMP (CAR (lst)))
+  VDOC ("Return t if object is a number.");
+  if (NUMP (argv[0]))
     return T;
   return NIL;
 }
 
-object_t *stringp (object_t * lst)
+object_t *stringp (int argc, object_t ** argv)
 {
-  DOC ("Return t if object is a string.");
-  REQ (lst, 1, c_sym ("stringp"));
-  if (STRINGP (CAR (lst)))
+  VDOC ("Return t if object is a string.");
+  if (STRINGP (argv[0]))
     return T;
   return NIL;
 }
 
-object_t *integerp (object_t * lst)
+object_t *integerp (int argc, object_t ** argv)
 {
-  DOC ("Return t if object is an integer.");
-  REQ (lst, 1, c_sym ("integerp"));
-  if (INTP (CAR (lst)))
+  VDOC ("Return t if object is an integer.");
+  if (INTP (argv[0]))
     return T;
   return NIL;
 }
 
-object_t *floatp (object_t * lst)
+object_t *floatp (int argc, object_t ** argv)
 {
-  DOC ("Return t if object is a floating-point number.");
-  REQ (lst, 1, c_sym ("floatp"));
-  if (FLOATP (CAR (lst)))
+  VDOC ("Return t if object is a floating-point number.");
+  if (FLOATP (argv[0]))
     return T;
   return NIL;
 }
 
-object_t *vectorp (object_t * lst)
+object_t *vectorp (int argc, object_t ** argv)
 {
-  DOC ("Return t if object is a vector.");
-  REQ (lst, 1, c_sym ("vectorp"));
-  if (VECTORP (CAR (lst)))
+  VDOC ("Return t if object is a vector.");
+  if (VECTORP (argv[0]))
     return T;
   return NIL;
 }
 
+object_t *hash_table_p (int argc, object_t ** argv)
+{
+  VDOC ("Return t if object is a hash table.");
+  if (HASHTABLEP (argv[0]))
+    return T;
+  return NIL;
+}
+
+object_t *closurep (int argc, object_t ** argv)
+{
+  VDOC ("Return t if object is a closure.");
+  if (CLOSUREP (argv[0]))
+    return T;
+  return NIL;
+}
+
+object_t *portp (int argc, object_t ** argv)
+{
+  VDOC ("Return t if object is a port.");
+  if (PORTP (argv[0]))
+    return T;
+  return NIL;
+}
+
+object_t *closure_function (int argc, object_t ** argv)
+{
+  VDOC ("Return the lambda expression a closure was made from.");
+  if (!CLOSUREP (argv[0]))
+    THROW (wrong_type, UPREF (argv[0]));
+  /* A new cons, since the closure's has its own code. */
+  object_t *fn = CLOSURE_FN (argv[0]);
+  return c_cons (lambda, c_cons (UPREF (CAR (fn)), UPREF (CDR (fn))));
+}
+
 /* Input/Output */
 
 object_t *lisp_load (object_t * lst)
 {
   DOC ("Evaluate contents of a file.");
-  REQ (lst, 1, c_sym ("load"));
+  REQ (lst, 1, sym_load);
   object_t *str = CAR (lst);
   if (!STRINGP (str))
     THROW (wrong_type, UPREF (str));
   char *filename = OSTR (str);
   int r = load_file (NULL, filename, 0);
   if (!r)
-    THROW (c_sym ("load-file-error"), UPREF (str));
+    THROW (load_file_error, UPREF (str));
   return T;
 }
 
 object_t *lisp_read_string (object_t * lst)
 {
   DOC ("Parse a string into a sexp or list object.");
-  REQ (lst, 1, c_sym ("eval-string"));
+  REQ (lst, 1, sym_eval_string);
   object_t *stro = CAR (lst);
   if (!STRINGP (stro))
     THROW (wrong_type, UPREF (stro));
@@ -505,7 +676,7 @@ object_t *lisp_read_string (object_t * lst)
   object_t *sexp = read_sexp (r);
   reader_destroy (r);
   if (sexp == err_symbol)
-    THROW (c_sym ("parse-error"), UPREF (stro));
+    THROW (parse_error, UPREF (stro));
   return sexp;
 }
 
@@ -540,13 +711,12 @@ object_t *catch (object_t * lst)
 
 /* Vectors */
 
-object_t *lisp_vset (object_t * lst)
+object_t *lisp_vset (int argc, object_t ** argv)
 {
-  DOC ("Set slot in a vector to object.");
-  REQ (lst, 3, c_sym ("vset"));
-  object_t *vec = CAR (lst);
-  object_t *ind = CAR (CDR (lst));
-  object_t *val = CAR (CDR (CDR (lst)));
+  VDOC ("Set slot in a vector to object.");
+  object_t *vec = argv[0];
+  object_t *ind = argv[1];
+  object_t *val = argv[2];
   if (!VECTORP (vec))
     THROW (wrong_type, UPREF (vec));
   if (!INTP (ind))
@@ -554,12 +724,11 @@ object_t *lisp_vset (object_t * lst)
   return vset_check (vec, ind, val);
 }
 
-object_t *lisp_vget (object_t * lst)
+object_t *lisp_vget (int argc, object_t ** argv)
 {
-  DOC ("Get object stored in vector slot.");
-  REQ (lst, 2, c_sym ("vget"));
-  object_t *vec = CAR (lst);
-  object_t *ind = CAR (CDR (lst));
+  VDOC ("Get object stored in vector slot.");
+  object_t *vec = argv[0];
+  object_t *ind = argv[1];
   if (!VECTORP (vec))
     THROW (wrong_type, UPREF (vec));
   if (!INTP (ind))
@@ -567,22 +736,20 @@ object_t *lisp_vget (object_t * lst)
   return vget_check (vec, ind);
 }
 
-object_t *lisp_vlength (object_t * lst)
+object_t *lisp_vlength (int argc, object_t ** argv)
 {
-  DOC ("Return length of the vector.");
-  REQ (lst, 1, c_sym ("vlength"));
-  object_t *vec = CAR (lst);
+  VDOC ("Return length of the vector.");
+  object_t *vec = argv[0];
   if (!VECTORP (vec))
     THROW (wrong_type, UPREF (vec));
   return c_int (VLENGTH (vec));
 }
 
-object_t *make_vector (object_t * lst)
+object_t *make_vector (int argc, object_t ** argv)
 {
-  DOC ("Make a new vector of given length, initialized to given object.");
-  REQ (lst, 2, c_sym ("make-vector"));
-  object_t *len = CAR (lst);
-  object_t *o = CAR (CDR (lst));
+  VDOC ("Make a new vector of given length, initialized to given object.");
+  object_t *len = argv[0];
+  object_t *o = argv[1];
   if (!INTP (len))
     THROW (wrong_type, UPREF (len));
   return c_vec (into2int (len), o);
@@ -591,7 +758,7 @@ object_t *make_vector (object_t * lst)
 object_t *lisp_vconcat (object_t * lst)
 {
   DOC ("Concatenate two vectors.");
-  REQ (lst, 2, c_sym ("vconcat2"));
+  REQ (lst, 2, sym_vconcat2);
   object_t *a = CAR (lst);
   object_t *b = CAR (CDR (lst));
   if (!VECTORP (a))
@@ -604,7 +771,7 @@ object_t *lisp_vconcat (object_t * lst)
 object_t *lisp_vsub (object_t * lst)
 {
   DOC ("Return subsection of vector.");
-  REQM (lst, 2, c_sym ("subv"));
+  REQM (lst, 2, sym_subv);
   object_t *v = CAR (lst);
   object_t *starto = CAR (CDR (lst));
   if (!VECTORP (v))
@@ -613,9 +780,9 @@ object_t *lisp_vsub (object_t * lst)
     THROW (wrong_type, UPREF (starto));
   int start = into2int (starto);
   if (start >= (int) VLENGTH (v))
-    THROW (c_sym ("bad-index"), UPREF (starto));
+    THROW (bad_index, UPREF (starto));
   if (start < 0)
-    THROW (c_sym ("bad-index"), UPREF (starto));
+    THROW (bad_index, UPREF (starto));
   if (CDR (CDR (lst)) == NIL)
     {
       /* to the end */
@@ -626,32 +793,146 @@ object_t *lisp_vsub (object_t * lst)
     THROW (wrong_type, UPREF (endo));
   int end = into2int (endo);
   if (end >= (int) VLENGTH (v))
-    THROW (c_sym ("bad-index"), UPREF (endo));
+    THROW (bad_index, UPREF (endo));
   if (end < start)
-    THROW (c_sym ("bad-index"), UPREF (endo));
+    THROW (bad_index, UPREF (endo));
   return vector_sub (v, start, end);
 }
 
+/* Hash tables */
+
+object_t *make_hash_table (int argc, object_t ** argv)
+{
+  VDOC ("Make a new hash table comparing keys with test, one of eq, eql\n"
+	"(the default) or equal, sized for the given number of items.\n"
+	"A lone integer argument is the size of an equal table, as with\n"
+	"the old wisplib hash tables.");
+  hash_test_t test = HASH_EQL;
+  object_t *size_arg = argc > 1 ? argv[1] : NIL;
+  size_t size = 0;
+  if (argc == 1 && INTP (argv[0]))
+    {
+      test = HASH_EQUAL;
+      size_arg = argv[0];
+    }
+  else if (argc > 0 && argv[0] != NIL)
+    {
+      if (argv[0] == sym_eq)
+	test = HASH_EQ;
+      else if (argv[0] == sym_equal)
+	test = HASH_EQUAL;
+      else if (argv[0] != sym_eql)
+	THROW (wrong_type, UPREF (argv[0]));
+    }
+  if (size_arg != NIL)
+    {
+      if (!INTP (size_arg))
+	THROW (wrong_type, UPREF (size_arg));
+      int n = into2int (size_arg);
+      size = n < 0 ? 0 : n;
+    }
+  return c_hashtable (test, size);
+}
+
+object_t *gethash (int argc, object_t ** argv)
+{
+  VDOC ("Return the value stored under key in table, or default.");
+  object_t *table = argv[1];
+  if (!HASHTABLEP (table))
+    THROW (wrong_type, UPREF (table));
+  object_t *r = hashtable_get (table, argv[0]);
+  if (r == NULL)
+    r = argc > 2 ? argv[2] : NIL;
+  return UPREF (r);
+}
+
+object_t *puthash (int argc, object_t ** argv)
+{
+  VDOC ("Store value under key in table, returning value.");
+  object_t *table = argv[2];
+  if (!HASHTABLEP (table))
+    THROW (wrong_type, UPREF (table));
+  hashtable_put (table, UPREF (argv[0]), UPREF (argv[1]));
+  return UPREF (argv[1]);
+}
+
+object_t *remhash (int argc, object_t ** argv)
+{
+  VDOC ("Remove key from table, returning t if it was there.");
+  object_t *table = argv[1];
+  if (!HASHTABLEP (table))
+    THROW (wrong_type, UPREF (table));
+  if (hashtable_remove (table, argv[0]))
+    return T;
+  return NIL;
+}
+
+object_t *hash_count (int argc, object_t ** argv)
+{
+  VDOC ("Return the number of items in table.");
+  object_t *table = argv[0];
+  if (!HASHTABLEP (table))
+    THROW (wrong_type, UPREF (table));
+  return c_int (OHASH (table)->count);
+}
+
+object_t *maphash (int argc, object_t ** argv)
+{
+  VDOC ("Call function with each key and value in table.");
+  object_t *f = argv[0], *table = argv[1];
+  if (!FUNCP (f))
+    THROW (wrong_type, UPREF (f));
+  if (!HASHTABLEP (table))
+    THROW (wrong_type, UPREF (table));
+
+  /* Work from a copy, so the function may change the table. */
+  hashtable_t *h = OHASH (table);
+  size_t i, n = 0;
+  object_t **items = xmalloc (sizeof (object_t *) * (h->count * 2 + 1));
+  for (i = 0; i < h->size; i++)
+    if (h->arr[i].key != NULL)
+      {
+	items[n++] = UPREF (h->arr[i].key);
+	items[n++] = UPREF (h->arr[i].value);
+      }
+  object_t *r = NIL;
+  for (i = 0; i < n && r != err_symbol; i += 2)
+    {
+      object_t *args = c_cons (items[i], c_cons (items[i + 1], NIL));
+      r = apply (f, args);
+      obj_destroy (args);
+      if (r != err_symbol)
+	{
+	  obj_destroy (r);
+	  r = NIL;
+	}
+    }
+  for (; i < n; i++)
+    obj_destroy (items[i]);
+  xfree (items);
+  return r;
+}
+
 /* Internals */
 
 object_t *lisp_refcount (object_t * lst)
 {
   DOC ("Return number of reference counts to object.");
-  REQ (lst, 1, c_sym ("refcount"));
+  REQ (lst, 1, sym_refcount);
   return c_int (CAR (lst)->refs);
 }
 
 object_t *lisp_eval_depth (object_t * lst)
 {
   DOC ("Return the current evaluation depth.");
-  REQ (lst, 0, c_sym ("eval-depth"));
+  REQ (lst, 0, sym_eval_depth);
   return c_int (stack_depth);
 }
 
 object_t *lisp_max_eval_depth (object_t * lst)
 {
   DOC ("Return or set the maximum evaluation depth.");
-  REQX (lst, 1, c_sym ("max-eval-depth"));
+  REQX (lst, 1, sym_max_eval_depth);
   if (lst == NIL)
     return c_int (max_stack_depth);
   object_t *arg = CAR (lst);
@@ -664,12 +945,104 @@ object_t *lisp_max_eval_depth (object_t * lst)
   return UPREF (arg);
 }
 
+object_t *lisp_collect_cycles (object_t * lst)
+{
+  DOC ("Free unreachable reference cycles, returning number of objects.");
+  REQ (lst, 0, sym_collect_cycles);
+  return c_int (cycle_collect ());
+}
+
+object_t *lisp_cycle_stats (object_t * lst)
+{
+  DOC ("Return cycle collector statistics.");
+  REQ (lst, 0, sym_cycle_stats);
+  size_t collections = cc_collections, reclaimed = cc_reclaimed;
+  double seconds = cc_seconds;
+  object_t *r = c_cons (c_sym (":seconds"), c_cons (c_float (seconds), NIL));
+  r = c_cons (c_sym (":reclaimed"), c_cons (c_int (reclaimed), r));
+  r = c_cons (c_sym (":collections"), c_cons (c_int (collections), r));
+  return r;
+}
+
+object_t *lisp_cycle_threshold (object_t * lst)
+{
+  DOC ("Return or set decrements between automatic cycle collections.");
+  REQX (lst, 1, sym_cycle_threshold);
+  if (lst == NIL)
+    return c_int (cc_threshold);
+  object_t *arg = CAR (lst);
+  if (!FIXP (arg) || OFIX (arg) < 0)
+    THROW (wrong_type, UPREF (arg));
+  cc_threshold = OFIX (arg);
+  return UPREF (arg);
+}
+
+object_t *lisp_destroy_budget (object_t * lst)
+{
+  DOC ("Return or set maximum objects freed per evaluation step.");
+  REQX (lst, 1, sym_destroy_budget);
+  if (lst == NIL)
+    return c_int (destroy_budget);
+  object_t *arg = CAR (lst);
+  if (!FIXP (arg) || OFIX (arg) < 0)
+    THROW (wrong_type, UPREF (arg));
+  destroy_budget = OFIX (arg);
+  return UPREF (arg);
+}
+
+object_t *lisp_memory_stats (object_t * lst)
+{
+  DOC ("Return allocation statistics for memory pools and types.");
+  REQ (lst, 0, sym_memory_stats);
+  object_t *pools = NIL;
+  mmanager_t *mm;
+  for (mm = mm_list; mm != NULL; mm = mm->next)
+    {
+      /* Read everything before allocating the result. */
+      size_t live = mm->live, peak = mm->peak, slabs = mm->slabs;
+      object_t *e = c_cons (c_sym (":bytes"),
+			    c_cons (c_int (slabs * SLAB_SIZE), NIL));
+      e = c_cons (c_sym (":slabs"), c_cons (c_int (slabs), e));
+      e = c_cons (c_sym (":peak"), c_cons (c_int (peak), e));
+      e = c_cons (c_sym (":live"), c_cons (c_int (live), e));
+      pools = c_cons (c_cons (c_sym (mm->name), e), pools);
+    }
+  object_t *types = NIL;
+  int i;
+  for (i = TYPE_COUNT - 1; i >= 0; i--)
+    {
+      size_t live = type_live[i], peak = type_peak[i];
+      object_t *e = c_cons (c_sym (":peak"), c_cons (c_int (peak), NIL));
+      e = c_cons (c_sym (":live"), c_cons (c_int (live), e));
+      types = c_cons (c_cons (c_sym (type_names[i]), e), types);
+    }
+  return c_cons (c_sym (":pools"), c_cons (pools,
+					   c_cons (c_sym (":types"),
+						   c_cons (types, NIL))));
+}
+
+object_t *lisp_memory_high_water (object_t * lst)
+{
+  DOC ("Return or set bytes of free memory kept before releasing slabs.");
+  REQX (lst, 1, sym_memory_high_water);
+  if (lst == NIL)
+    return c_int (mm_high_water);
+  object_t *arg = CAR (lst);
+  if (!FIXP (arg) || OFIX (arg) < 0)
+    THROW (wrong_type, UPREF (arg));
+  mm_high_water = OFIX (arg);
+  mmanager_t *mm;
+  for (mm = mm_list; mm != NULL; mm = mm->next)
+    mm->high_water = mm_high_water;
+  return UPREF (arg);
+}
+
 /* System */
 
 object_t *lisp_exit (object_t * lst)
 {
   DOC ("Halt the interpreter and return given integer.");
-  REQX (lst, 1, c_sym ("exit"));
+  REQX (lst, 1, sym_exit);
   if (lst == NIL)
     exit (EXIT_SUCCESS);
   if (!INTP (CAR (lst)))
@@ -692,63 +1065,98 @@ void lisp_init ()
   SSET (c_sym ("lambda"), c_special (&lambda_f));
   SSET (c_sym ("defun"), c_special (&defun));
   SSET (c_sym ("defmacro"), c_special (&defmacro));
-  SSET (c_sym ("car"), c_cfunc (&lisp_car));
-  SSET (c_sym ("cdr"), c_cfunc (&lisp_cdr));
+  SSET (c_sym ("car"), c_vfunc (&lisp_car, 1, 1));
+  SSET (c_sym ("cdr"), c_vfunc (&lisp_cdr, 1, 1));
   SSET (c_sym ("list"), c_cfunc (&lisp_list));
   SSET (c_sym ("if"), c_special (&lisp_if));
-  SSET (c_sym ("not"), c_cfunc (&nullp));
+  SSET (c_sym ("not"), c_vfunc (&nullp, 1, 1));
   SSET (c_sym ("progn"), c_special (&progn));
   SSET (c_sym ("let"), c_special (&let));
   SSET (c_sym ("while"), c_special (&lisp_while));
   SSET (c_sym ("eval"), c_cfunc (&eval_body));
   SSET (c_sym ("print"), c_cfunc (&lisp_print));
-  SSET (c_sym ("cons"), c_cfunc (&lisp_cons));
+  SSET (c_sym ("prin1-to-string"), c_vfunc (&lisp_prin1_to_string, 1, 1));
+  SSET (c_sym ("cons"), c_vfunc (&lisp_cons, 2, 2));
   SSET (c_sym ("cond"), c_special (&lisp_cond));
+  SSET (c_sym ("macroexpand-1"), c_cfunc (&lisp_macroexpand_1));
+  SSET (c_sym ("macroexpand"), c_cfunc (&lisp_macroexpand));
+  SSET (c_sym ("macroexpand-all"), c_cfunc (&lisp_macroexpand_all));
 
   /* Symbol table */
-  SSET (c_sym ("set"), c_cfunc (&lisp_set));
-  SSET (c_sym ("value"), c_cfunc (&lisp_value));
-  SSET (c_sym ("symbol-name"), c_cfunc (&symbol_name));
+  SSET (c_sym ("set"), c_vfunc (&lisp_set, 2, 2));
+  SSET (c_sym ("value"), c_vfunc (&lisp_value, 1, 1));
+  SSET (c_sym ("symbol-name"), c_vfunc (&symbol_name, 1, 1));
 
   /* Strings */
-  SSET (c_sym ("concat2"), c_cfunc (&lisp_concat));
+  SSET (c_sym ("concat2"), c_vfunc (&lisp_concat, 2, 2));
 
   /* Equality */
-  SSET (c_sym ("eq"), c_cfunc (&eq));
-  SSET (c_sym ("eql"), c_cfunc (&eql));
-  SSET (c_sym ("hash"), c_cfunc (&lisp_hash));
+  SSET (c_sym ("eq"), c_vfunc (&eq, 2, 2));
+  SSET (c_sym ("eql"), c_vfunc (&eql, 2, 2));
+  SSET (c_sym ("hash"), c_vfunc (&lisp_hash, 1, 1));
 
   /* Predicates */
-  SSET (c_sym ("nullp"), c_cfunc (&nullp));
-  SSET (c_sym ("funcp"), c_cfunc (&funcp));
-  SSET (c_sym ("listp"), c_cfunc (&listp));
-  SSET (c_sym ("symbolp"), c_cfunc (&symbolp));
-  SSET (c_sym ("stringp"), c_cfunc (&stringp));
-  SSET (c_sym ("numberp"), c_cfunc (&numberp));
-  SSET (c_sym ("integerp"), c_cfunc (&integerp));
-  SSET (c_sym ("floatp"), c_cfunc (&floatp));
-  SSET (c_sym ("vectorp"), c_cfunc (&vectorp));
+  SSET (c_sym ("nullp"), c_vfunc (&nullp, 1, 1));
+  SSET (c_sym ("funcp"), c_vfunc (&funcp, 1, 1));
+  SSET (c_sym ("listp"), c_vfunc (&listp, 1, 1));
+  SSET (c_sym ("symbolp"), c_vfunc (&symbolp, 1, 1));
+  SSET (c_sym ("stringp"), c_vfunc (&stringp, 1, 1));
+  SSET (c_sym ("numberp"), c_vfunc (&numberp, 1, 1));
+  SSET (c_sym ("integerp"), c_vfunc (&integerp, 1, 1));
+  SSET (c_sym ("floatp"), c_vfunc (&floatp, 1, 1));
+  SSET (c_sym ("vectorp"), c_vfunc (&vectorp, 1, 1));
+  SSET (c_sym ("hash-table-p"), c_vfunc (&hash_table_p, 1, 1));
+  SSET (c_sym ("closurep"), c_vfunc (&closurep, 1, 1));
+  SSET (c_sym ("portp"), c_vfunc (&portp, 1, 1));
+  SSET (c_sym ("closure-function"), c_vfunc (&closure_function, 1, 1));
 
   /* Input/Output */
   SSET (c_sym ("load"), c_cfunc (&lisp_load));
   SSET (c_sym ("read-string"), c_cfunc (&lisp_read_string));
+  SSET (c_sym ("write-binary"), c_vfunc (&lisp_write_binary, 1, 1));
+  SSET (c_sym ("read-binary"), c_vfunc (&lisp_read_binary, 1, 1));
+  SSET (c_sym ("fasl-file"), c_vfunc (&lisp_fasl_file, 1, 1));
+
+  /* Ports */
+  SSET (c_sym ("open-input-file"), c_vfunc (&lisp_open_input_file, 1, 1));
+  SSET (c_sym ("open-output-file"), c_vfunc (&lisp_open_output_file, 1, 1));
+  SSET (c_sym ("close-port"), c_vfunc (&lisp_close_port, 1, 1));
+  SSET (c_sym ("read-line"), c_vfunc (&lisp_read_line, 1, 1));
+  SSET (c_sym ("read-bytes"), c_vfunc (&lisp_read_bytes, 2, 2));
+  SSET (c_sym ("read"), c_vfunc (&lisp_read, 1, 2));
+  SSET (c_sym ("write"), c_vfunc (&lisp_write, 2, 2));
+  SSET (c_sym ("write-string"), c_vfunc (&lisp_write_string, 2, 2));
 
   /* Error handling */
   SSET (c_sym ("throw"), c_cfunc (&throw));
   SSET (c_sym ("catch"), c_special (&catch));
 
   /* Vectors */
-  SSET (c_sym ("vset"), c_cfunc (&lisp_vset));
-  SSET (c_sym ("vget"), c_cfunc (&lisp_vget));
-  SSET (c_sym ("vlength"), c_cfunc (&lisp_vlength));
-  SSET (c_sym ("make-vector"), c_cfunc (&make_vector));
+  SSET (c_sym ("vset"), c_vfunc (&lisp_vset, 3, 3));
+  SSET (c_sym ("vget"), c_vfunc (&lisp_vget, 2, 2));
+  SSET (c_sym ("vlength"), c_vfunc (&lisp_vlength, 1, 1));
+  SSET (c_sym ("make-vector"), c_vfunc (&make_vector, 2, 2));
   SSET (c_sym ("vconcat2"), c_cfunc (&lisp_vconcat));
   SSET (c_sym ("vsub"), c_cfunc (&lisp_vsub));
 
+  /* Hash tables */
+  SSET (c_sym ("make-hash-table"), c_vfunc (&make_hash_table, 0, 2));
+  SSET (c_sym ("gethash"), c_vfunc (&gethash, 2, 3));
+  SSET (c_sym ("puthash"), c_vfunc (&puthash, 3, 3));
+  SSET (c_sym ("remhash"), c_vfunc (&remhash, 2, 2));
+  SSET (c_sym ("hash-count"), c_vfunc (&hash_count, 1, 1));
+  SSET (c_sym ("maphash"), c_vfunc (&maphash, 2, 2));
+
   /* Internals */
   SSET (c_sym ("refcount"), c_cfunc (&lisp_refcount));
   SSET (c_sym ("eval-depth"), c_cfunc (&lisp_eval_depth));
   SSET (c_sym ("max-eval-depth"), c_cfunc (&lisp_max_eval_depth));
+  SSET (c_sym ("memory-stats"), c_cfunc (&lisp_memory_stats));
+  SSET (c_sym ("memory-high-water"), c_cfunc (&lisp_memory_high_water));
+  SSET (c_sym ("collect-cycles"), c_cfunc (&lisp_collect_cycles));
+  SSET (c_sym ("cycle-stats"), c_cfunc (&lisp_cycle_stats));
+  SSET (c_sym ("cycle-threshold"), c_cfunc (&lisp_cycle_threshold));
+  SSET (c_sym ("destroy-budget"), c_cfunc (&lisp_destroy_budget));
 
   /* System */
   SSET (c_sym ("exit"), c_cfunc (&lisp_exit));
@@ -757,4 +1165,10 @@ void lisp_init ()
   SSET (c_sym ("detach"), c_cfunc (&lisp_detach));
   SSET (c_sym ("receive"), c_cfunc (&lisp_receive));
   SSET (c_sym ("send"), c_cfunc (&lisp_send));
+  SSET (c_sym ("receive-batch"), c_vfunc (&lisp_receive_batch, 1, 1));
+  SSET (c_sym ("send-batch"), c_vfunc (&lisp_send_batch, 1, 1));
+  SSET (c_sym ("receive-any"), c_vfunc (&lisp_receive_any, 1, 2));
+  SSET (c_sym ("ready-p"), c_vfunc (&lisp_ready_p, 1, 1));
+  SSET (c_sym ("pmap"), c_vfunc (&lisp_pmap, 2, 3));
+  SSET (c_sym ("preduce"), c_vfunc (&lisp_preduce, 2, 3));
 }
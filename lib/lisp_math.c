@@ -1,5 +1,8 @@
 #include <stdio.h>
+#include <stdlib.h>
+#include <limits.h>
 #include <gmp.h>
+#include <math.h>
 #include "wisp.h"
 
 typedef enum arith_enum
@@ -8,228 +11,357 @@ typedef enum arith_enum
 typedef enum cmp_enum
 { EQ, LT, LTE, GT, GTE, } cmp_t;
 
-/* Maths */
-object_t *arith (arith_t op, object_t * lst)
+/* Numeric contagion: integers, then flonums, then bigfloats. */
+typedef enum mode_enum
+{ INTMODE, FLOMODE, MPFMODE } nmode_t;
+
+/* Fixnum operation, returning 0 if it doesn't fit in a fixnum. */
+static int arith_fix (arith_t op, long a, long b, long *r)
+{
+  switch (op)
+    {
+    case ADD:
+      return !__builtin_add_overflow (a, b, r);
+    case SUB:
+      return !__builtin_sub_overflow (a, b, r);
+    case MUL:
+      return !__builtin_mul_overflow (a, b, r);
+    case DIV:
+      if (b == 0 || (a == LONG_MIN && b == -1))
+	return 0;
+      /* Round toward negative infinity, like mpz_div(). */
+      *r = a / b;
+      if (a % b != 0 && ((a < 0) != (b < 0)))
+	(*r)--;
+      return 1;
+    }
+  return 0;
+}
+
+static double arith_flo (arith_t op, double a, double b)
 {
-  if (op == DIV)
-    REQM (lst, 2, c_sym ("div"));
-  int intmode = 1;
-  object_t *accumz = NIL, *accumf = NIL, *convf = c_float (0);
   switch (op)
     {
+    case ADD:
+      return a + b;
     case SUB:
+      return a - b;
+    case MUL:
+      return a * b;
+    case DIV:
+      return a / b;
+    }
+  return 0;
+}
+
+static void arith_mpz (arith_t op, mpz_t r, mpz_t a, mpz_t b)
+{
+  switch (op)
+    {
     case ADD:
-      accumz = c_int (0);
-      accumf = c_float (0);
+      mpz_add (r, a, b);
+      break;
+    case SUB:
+      mpz_sub (r, a, b);
       break;
     case MUL:
+      mpz_mul (r, a, b);
+      break;
     case DIV:
-      accumz = c_int (1);
-      accumf = c_float (1);
+      mpz_div (r, a, b);
       break;
     }
-  if (op == SUB || op == DIV)
+}
+
+static void arith_mpf (arith_t op, mpf_t r, mpf_t a, mpf_t b)
+{
+  switch (op)
     {
-      object_t *num = CAR (lst);
-      if (FLOATP (num))
-	{
-	  intmode = 0;
-	  mpf_set (DFLOAT (accumf), DFLOAT (num));
-	}
-      else if (INTP (num))
-	{
-	  mpf_set_z (DFLOAT (accumf), DINT (num));
-	  mpz_set (DINT (accumz), DINT (num));
-	}
-      else
-	{
-	  obj_destroy (accumz);
-	  obj_destroy (accumf);
-	  obj_destroy (convf);
-	  THROW (wrong_type, UPREF (num));
-	}
-      if (op == SUB && CDR (lst) == NIL)
-	{
-	  if (intmode)
-	    {
-	      obj_destroy (accumf);
-	      obj_destroy (convf);
-	      mpz_neg (DINT (accumz), DINT (accumz));
-	      return accumz;
-	    }
-	  else
-	    {
-	      obj_destroy (accumz);
-	      obj_destroy (convf);
-	      mpf_neg (DFLOAT (accumf), DFLOAT (accumf));
-	      return accumf;
-	    }
-	}
-      lst = CDR (lst);
+    case ADD:
+      mpf_add (r, a, b);
+      break;
+    case SUB:
+      mpf_sub (r, a, b);
+      break;
+    case MUL:
+      mpf_mul (r, a, b);
+      break;
+    case DIV:
+      mpf_div (r, a, b);
+      break;
+    }
+}
+
+/* Sign of a number object. */
+static int num_sgn (object_t * o)
+{
+  if (FIXP (o))
+    return (OFIX (o) > 0) - (OFIX (o) < 0);
+  if (FLONUMP (o))
+    return (OFLO (o) > 0) - (OFLO (o) < 0);
+  if (INTP (o))
+    return mpz_sgn (DINT (o));
+  return mpf_sgn (DFLOAT (o));
+}
+
+/* Set mpf to value of any number object. Returns 0 for infinities
+ * and NaN, which a bigfloat can't hold. */
+static int numo2mpf (object_t * o, mpf_t f)
+{
+  if (FIXP (o))
+    mpf_set_si (f, OFIX (o));
+  else if (INTP (o))
+    mpf_set_z (f, DINT (o));
+  else if (FLONUMP (o))
+    {
+      if (!isfinite (OFLO (o)))
+	return 0;
+      mpf_set_d (f, OFLO (o));
+    }
+  else
+    mpf_set (f, DFLOAT (o));
+  return 1;
+}
+
+/* Two-operand fast path, allocating only the result. Returns NULL
+ * when the general path is needed (bignums, bigfloats, overflow,
+ * errors). */
+static object_t *arith2 (arith_t op, object_t * a, object_t * b)
+{
+  if (FIXP (a) && FIXP (b))
+    {
+      long r;
+      if (arith_fix (op, OFIX (a), OFIX (b), &r))
+	return c_int (r);
+      return NULL;
     }
+  if (!FLONUMP (a) && !FLONUMP (b))
+    return NULL;
+  if (!NUMP (a) || !NUMP (b) || BIGFLOATP (a) || BIGFLOATP (b))
+    return NULL;
+  if (op == DIV && num_sgn (b) == 0)
+    return NULL;
+  return c_float (arith_flo (op, numo2float (a), numo2float (b)));
+}
 
-  while (lst != NIL)
+/* Maths */
+object_t *arith (arith_t op, int argc, object_t ** argv)
+{
+  if (argc == 2)
     {
-      object_t *num = CAR (lst);
-      if (!NUMP (num))
+      object_t *r = arith2 (op, argv[0], argv[1]);
+      if (r != NULL)
+	return r;
+    }
+
+  /* General case: accumulate in the widest mode seen so far. */
+  nmode_t mode = INTMODE;
+  mpz_t accumz, convz;
+  mpf_t accumf, convf;
+  double accumd = 0;
+  mpz_init_set_si (accumz, (op == ADD || op == SUB) ? 0 : 1);
+  mpz_init (convz);
+  int first = (op == SUB || op == DIV), i;
+  for (i = 0; i < argc; i++)
+    {
+      object_t *num = argv[i];
+      if (!NUMP (num) || (op == DIV && !first && num_sgn (num) == 0))
 	{
-	  obj_destroy (accumz);
-	  obj_destroy (accumf);
-	  obj_destroy (convf);
-	  THROW (wrong_type, UPREF (num));
+	  mpz_clears (accumz, convz, NULL);
+	  if (mode == MPFMODE)
+	    mpf_clears (accumf, convf, NULL);
+	  if (!NUMP (num))
+	    THROW (wrong_type, UPREF (num));
+	  THROW (divide_by_zero, UPREF (num));
 	}
-      /* Check divide by zero */
-      if (op == DIV)
+
+      /* Promote the accumulator. */
+      if (BIGFLOATP (num) && mode != MPFMODE)
 	{
-	  double dnum;
-	  if (FLOATP (num))
-	    dnum = floato2float (num);
+	  mpf_init2 (accumf, mpf_get_prec (DFLOAT (num)));
+	  mpf_init2 (convf, mpf_get_prec (DFLOAT (num)));
+	  if (mode == INTMODE)
+	    mpf_set_z (accumf, accumz);
+	  else if (isfinite (accumd))
+	    mpf_set_d (accumf, accumd);
 	  else
-	    dnum = into2int (num);
-	  if (dnum == 0)
 	    {
-	      obj_destroy (accumz);
-	      obj_destroy (accumf);
-	      obj_destroy (convf);
-	      THROW (c_sym ("divide-by-zero"), UPREF (num));
+	      mpz_clears (accumz, convz, NULL);
+	      mpf_clears (accumf, convf, NULL);
+	      THROW (wrong_type, c_float (accumd));
 	    }
+	  mode = MPFMODE;
 	}
-
-      if (intmode)
+      else if (BIGFLOATP (num) && mpf_get_prec (DFLOAT (num))
+	       > mpf_get_prec (accumf))
 	{
-	  if (FLOATP (num))
-	    {
-	      intmode = 0;
-	      mpf_set_z (DFLOAT (accumf), DINT (accumz));
-	      /* Fall through to !intmode */
-	    }
-	  else if (INTP (num))
-	    {
-	      switch (op)
-		{
-		case ADD:
-		  mpz_add (DINT (accumz), DINT (accumz), DINT (CAR (lst)));
-		  break;
-		case MUL:
-		  mpz_mul (DINT (accumz), DINT (accumz), DINT (CAR (lst)));
-		  break;
-		case SUB:
-		  mpz_sub (DINT (accumz), DINT (accumz), DINT (CAR (lst)));
-		  break;
-		case DIV:
-		  mpz_div (DINT (accumz), DINT (accumz), DINT (CAR (lst)));
-		  break;
-		}
-	    }
+	  mpf_set_prec (accumf, mpf_get_prec (DFLOAT (num)));
+	  mpf_set_prec (convf, mpf_get_prec (DFLOAT (num)));
+	}
+      else if (FLONUMP (num) && mode == INTMODE)
+	{
+	  accumd = mpz_get_d (accumz);
+	  mode = FLOMODE;
 	}
-      if (!intmode)
+
+      switch (mode)
 	{
-	  if (FLOATP (num))
-	    switch (op)
-	      {
-	      case ADD:
-		mpf_add (DFLOAT (accumf), DFLOAT (accumf), DFLOAT (num));
-		break;
-	      case MUL:
-		mpf_mul (DFLOAT (accumf), DFLOAT (accumf), DFLOAT (num));
-		break;
-	      case SUB:
-		mpf_sub (DFLOAT (accumf), DFLOAT (accumf), DFLOAT (num));
-		break;
-	      case DIV:
-		mpf_div (DFLOAT (accumf), DFLOAT (accumf), DFLOAT (num));
-		break;
-	      }
-	  else if (INTP (num))
+	case INTMODE:
+	  into2mpz (num, convz);
+	  if (first)
+	    mpz_set (accumz, convz);
+	  else
+	    arith_mpz (op, accumz, accumz, convz);
+	  break;
+	case FLOMODE:
+	  if (first)
+	    accumd = numo2float (num);
+	  else
+	    accumd = arith_flo (op, accumd, numo2float (num));
+	  break;
+	case MPFMODE:
+	  if (!numo2mpf (num, convf))
 	    {
-	      /* Convert to float and add. */
-	      mpf_set_z (DFLOAT (convf), DINT (num));
-	      switch (op)
-		{
-		case ADD:
-		  mpf_add (DFLOAT (accumf), DFLOAT (accumf), DFLOAT (convf));
-		  break;
-		case MUL:
-		  mpf_mul (DFLOAT (accumf), DFLOAT (accumf), DFLOAT (convf));
-		  break;
-		case SUB:
-		  mpf_sub (DFLOAT (accumf), DFLOAT (accumf), DFLOAT (convf));
-		  break;
-		case DIV:
-		  mpf_div (DFLOAT (accumf), DFLOAT (accumf), DFLOAT (convf));
-		  break;
-		}
+	      mpz_clears (accumz, convz, NULL);
+	      mpf_clears (accumf, convf, NULL);
+	      THROW (wrong_type, UPREF (num));
 	    }
+	  if (first)
+	    mpf_set (accumf, convf);
+	  else
+	    arith_mpf (op, accumf, accumf, convf);
+	  break;
 	}
-      lst = CDR (lst);
+      first = 0;
+    }
+
+  /* Unary minus */
+  if (op == SUB && argc == 1)
+    {
+      mpz_neg (accumz, accumz);
+      accumd = -accumd;
+      if (mode == MPFMODE)
+	mpf_neg (accumf, accumf);
     }
-  obj_destroy (convf);
 
-  /* Destroy whatever went unused. */
-  if (intmode)
+  object_t *r;
+  if (mode == INTMODE)
+    r = c_mpz (accumz);
+  else if (mode == FLOMODE)
+    r = c_float (accumd);
+  else
     {
-      obj_destroy (accumf);
-      return accumz;
+      r = c_mpf (accumf);
+      mpf_clears (accumf, convf, NULL);
     }
-  obj_destroy (accumz);
-  return accumf;
+  mpz_clears (accumz, convz, NULL);
+  return r;
 }
 
-object_t *addition (object_t * lst)
+object_t *addition (int argc, object_t ** argv)
 {
-  DOC ("Perform addition operation.");
-  return arith (ADD, lst);
+  VDOC ("Perform addition operation.");
+  return arith (ADD, argc, argv);
 }
 
-object_t *multiplication (object_t * lst)
+object_t *multiplication (int argc, object_t ** argv)
 {
-  DOC ("Perform multiplication operation.");
-  return arith (MUL, lst);
+  VDOC ("Perform multiplication operation.");
+  return arith (MUL, argc, argv);
 }
 
-object_t *subtraction (object_t * lst)
+object_t *subtraction (int argc, object_t ** argv)
 {
-  DOC ("Perform subtraction operation.");
-  return arith (SUB, lst);
+  VDOC ("Perform subtraction operation.");
+  return arith (SUB, argc, argv);
 }
 
-object_t *division (object_t * lst)
+object_t *division (int argc, object_t ** argv)
 {
-  DOC ("Perform division operation.");
-  return arith (DIV, lst);
+  VDOC ("Perform division operation.");
+  return arith (DIV, argc, argv);
 }
 
-object_t *num_cmp (cmp_t cmp, object_t * lst)
+/* Compare two integers without allocating. */
+static int int_cmp (object_t * a, object_t * b)
 {
-  REQM (lst, 2, c_sym ("compare-func"));
-  object_t *a = CAR (lst);
-  object_t *b = CAR (CDR (lst));
+  int r;
+  if (FIXP (a))
+    r = -mpz_cmp_si (DINT (b), OFIX (a));
+  else if (FIXP (b))
+    r = mpz_cmp_si (DINT (a), OFIX (b));
+  else
+    r = mpz_cmp (DINT (a), DINT (b));
+  return (r > 0) - (r < 0);
+}
+
+/* Comparison result when either side is NaN. */
+#define UNORDERED 2
+
+/* Exactly compare a double to a fixnum. */
+static int flo_fix_cmp (double d, long n)
+{
+  if (d != d)
+    return UNORDERED;
+  if (d >= 9223372036854775808.0)
+    return 1;
+  if (d < -9223372036854775808.0)
+    return -1;
+  long t = (long) d;
+  if (t != n)
+    return (t > n) - (t < n);
+  return (d > t) - (d < t);
+}
+
+/* Compare float to any number without allocating. */
+static int float_cmp (object_t * f, object_t * n)
+{
+  int r;
+  if (FLONUMP (n) && OFLO (n) != OFLO (n))
+    return UNORDERED;
+  if (FLONUMP (f))
+    {
+      double d = OFLO (f);
+      if (FIXP (n))
+	return flo_fix_cmp (d, OFIX (n));
+      else if (d != d)
+	return UNORDERED;
+      else if (INTP (n))
+	return -mpz_cmp_d (DINT (n), d);
+      else if (FLONUMP (n))
+	return (d > OFLO (n)) - (d < OFLO (n));
+      r = -mpf_cmp_d (DFLOAT (n), d);
+    }
+  else if (FIXP (n))
+    r = mpf_cmp_si (DFLOAT (f), OFIX (n));
+  else if (INTP (n))
+    r = mpf_cmp_z (DFLOAT (f), DINT (n));
+  else if (FLONUMP (n))
+    r = mpf_cmp_d (DFLOAT (f), OFLO (n));
+  else
+    r = mpf_cmp (DFLOAT (f), DFLOAT (n));
+  return (r > 0) - (r < 0);
+}
+
+object_t *num_cmp (cmp_t cmp, object_t ** argv)
+{
+  object_t *a = argv[0];
+  object_t *b = argv[1];
   if (!NUMP (a))
     THROW (wrong_type, UPREF (a));
   if (!NUMP (b))
     THROW (wrong_type, UPREF (b));
-  int r = 0, invr = 1;
-  if (INTP (a) && INTP (b))
-    r = mpz_cmp (DINT (a), DINT (b));
-  else if (FLOATP (a) && FLOATP (b))
-    r = mpf_cmp (DFLOAT (a), DFLOAT (b));
-  else if (INTP (a) && FLOATP (b))
-    {
-      /* Swap and handle below. */
-      object_t *c = b;
-      b = a;
-      a = c;
-      invr = -1;
-    }
-  if (FLOATP (a) && INTP (b))
-    {
-      /* Convert down. */
-      object_t *convf = c_float (0);
-      mpf_set_z (DFLOAT (convf), DINT (b));
-      r = mpf_cmp (DFLOAT (a), DFLOAT (convf));
-      obj_destroy (convf);
-    }
-  r *= invr;
+  int r;
+  if (FIXP (a) && FIXP (b))
+    r = (OFIX (a) > OFIX (b)) - (OFIX (a) < OFIX (b));
+  else if (INTP (a) && INTP (b))
+    r = int_cmp (a, b);
+  else if (FLOATP (a))
+    r = float_cmp (a, b);
+  else if ((r = float_cmp (b, a)) != UNORDERED)
+    r = -r;
+  if (r == UNORDERED)
+    return NIL;
   switch (cmp)
     {
     case EQ:
@@ -253,62 +385,103 @@ object_t *num_cmp (cmp_t cmp, object_t * lst)
   return NIL;
 }
 
-object_t *num_eq (object_t * lst)
+object_t *num_eq (int argc, object_t ** argv)
 {
-  DOC ("Compare two numbers by =.");
-  return num_cmp (EQ, lst);
+  VDOC ("Compare two numbers by =.");
+  return num_cmp (EQ, argv);
 }
 
-object_t *num_lt (object_t * lst)
+object_t *num_lt (int argc, object_t ** argv)
 {
-  DOC ("Compare two numbers by <.");
-  return num_cmp (LT, lst);
+  VDOC ("Compare two numbers by <.");
+  return num_cmp (LT, argv);
 }
 
-object_t *num_lte (object_t * lst)
+object_t *num_lte (int argc, object_t ** argv)
 {
-  DOC ("Compare two numbers by <=.");
-  return num_cmp (LTE, lst);
+  VDOC ("Compare two numbers by <=.");
+  return num_cmp (LTE, argv);
 }
 
-object_t *num_gt (object_t * lst)
+object_t *num_gt (int argc, object_t ** argv)
 {
-  DOC ("Compare two numbers by >.");
-  return num_cmp (GT, lst);
+  VDOC ("Compare two numbers by >.");
+  return num_cmp (GT, argv);
 }
 
-object_t *num_gte (object_t * lst)
+object_t *num_gte (int argc, object_t ** argv)
 {
-  DOC ("Compare two numbers by >=.");
-  return num_cmp (GTE, lst);
+  VDOC ("Compare two numbers by >=.");
+  return num_cmp (GTE, argv);
 }
 
-object_t *modulus (object_t * lst)
+object_t *modulus (int argc, object_t ** argv)
 {
-  DOC ("Return modulo of arguments.");
-  REQ (lst, 2, c_sym ("%"));
-  object_t *a = CAR (lst);
-  object_t *b = CAR (CDR (lst));
+  VDOC ("Return modulo of arguments.");
+  object_t *a = argv[0];
+  object_t *b = argv[1];
   if (!INTP (a))
     THROW (wrong_type, UPREF (a));
   if (!INTP (b))
     THROW (wrong_type, UPREF (b));
-  object_t *m = c_int (0);
-  mpz_mod (DINT (m), DINT (a), DINT (b));
+  if (FIXP (b) && OFIX (b) == 0)
+    THROW (divide_by_zero, UPREF (b));
+  if (FIXP (a) && FIXP (b) && OFIX (b) != -1 && OFIX (b) != LONG_MIN)
+    {
+      /* Same sign convention as mpz_mod(). */
+      long m = OFIX (a) % OFIX (b);
+      if (m < 0)
+	m += labs (OFIX (b));
+      return c_int (m);
+    }
+  mpz_t az, bz;
+  mpz_inits (az, bz, NULL);
+  into2mpz (a, az);
+  into2mpz (b, bz);
+  mpz_mod (az, az, bz);
+  object_t *m = c_mpz (az);
+  mpz_clears (az, bz, NULL);
   return m;
 }
 
+object_t *bigfloat (int argc, object_t ** argv)
+{
+  VDOC ("Convert number to an arbitrary precision float of given bits.");
+  object_t *num = argv[0];
+  if (!NUMP (num))
+    THROW (wrong_type, UPREF (num));
+  long prec = BIGFLOAT_PREC;
+  if (argc > 1)
+    {
+      object_t *po = argv[1];
+      if (!FIXP (po) || OFIX (po) <= 0)
+	THROW (wrong_type, UPREF (po));
+      prec = OFIX (po);
+    }
+  mpf_t f;
+  mpf_init2 (f, prec);
+  if (!numo2mpf (num, f))
+    {
+      mpf_clear (f);
+      THROW (wrong_type, UPREF (num));
+    }
+  object_t *r = c_mpf (f);
+  mpf_clear (f);
+  return r;
+}
+
 /* Install all the math functions */
 void lisp_math_init ()
 {
-  SSET (c_sym ("+"), c_cfunc (&addition));
-  SSET (c_sym ("*"), c_cfunc (&multiplication));
-  SSET (c_sym ("-"), c_cfunc (&subtraction));
-  SSET (c_sym ("/"), c_cfunc (&division));
-  SSET (c_sym ("="), c_cfunc (&num_eq));
-  SSET (c_sym ("<"), c_cfunc (&num_lt));
-  SSET (c_sym ("<="), c_cfunc (&num_lte));
-  SSET (c_sym (">"), c_cfunc (&num_gt));
-  SSET (c_sym (">="), c_cfunc (&num_gte));
-  SSET (c_sym ("%"), c_cfunc (&modulus));
+  SSET (c_sym ("+"), c_vfunc (&addition, 0, -1));
+  SSET (c_sym ("*"), c_vfunc (&multiplication, 0, -1));
+  SSET (c_sym ("-"), c_vfunc (&subtraction, 0, -1));
+  SSET (c_sym ("/"), c_vfunc (&division, 2, -1));
+  SSET (c_sym ("="), c_vfunc (&num_eq, 2, 2));
+  SSET (c_sym ("<"), c_vfunc (&num_lt, 2, 2));
+  SSET (c_sym ("<="), c_vfunc (&num_lte, 2, 2));
+  SSET (c_sym (">"), c_vfunc (&num_gt, 2, 2));
+  SSET (c_sym (">="), c_vfunc (&num_gte, 2, 2));
+  SSET (c_sym ("%"), c_vfunc (&modulus, 2, 2));
+  SSET (c_sym ("bigfloat"), c_vfunc (&bigfloat, 1, 2));
 }
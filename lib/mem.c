@@ -1,57 +1,146 @@
 #include <stdint.h>
+#include <stdio.h>
+#include <string.h>
+#include <errno.h>
+#include <sys/mman.h>
 #include "common.h"
 #include "mem.h"
 
-void mm_fill_stack (mmanager_t * mm)
+mmanager_t *mm_list = NULL;
+size_t mm_high_water = 1024 * 1024;
+
+/* Free objects are chained through their last word, so the rest of
+ * the object keeps whatever clearf() put there. */
+#define LINK(mm, o) (*(void **) ((uint8_t *) (o) + (mm)->osize \
+				  - sizeof (void *)))
+#define SLAB_OF(o) ((slab_t *) ((uintptr_t) (o) & ~(uintptr_t) \
+				(SLAB_SIZE - 1)))
+#define SLAB_START(mm) ((sizeof (slab_t) + (mm)->osize - 1) \
+			/ (mm)->osize * (mm)->osize)
+
+static void slab_unlink (slab_t ** list, slab_t * s)
+{
+  if (s->prev != NULL)
+    s->prev->next = s->next;
+  else
+    *list = s->next;
+  if (s->next != NULL)
+    s->next->prev = s->prev;
+}
+
+static void slab_link (slab_t ** list, slab_t * s)
 {
-  uint8_t *p = xmalloc ((mm->size - (mm->stack - mm->base)) * mm->osize);
-  for (; mm->stack < mm->base + mm->size; mm->stack++, p += mm->osize)
+  s->prev = NULL;
+  s->next = *list;
+  if (*list != NULL)
+    (*list)->prev = s;
+  *list = s;
+}
+
+/* Get an aligned slab straight from the OS so it can be given back. */
+static slab_t *slab_create (mmanager_t * mm)
+{
+  uint8_t *p = mmap (NULL, SLAB_SIZE * 2, PROT_READ | PROT_WRITE,
+		     MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+  if (p == MAP_FAILED)
+    {
+      fprintf (stderr, "error: fatal: out of memory: %s\n", strerror (errno));
+      exit (EXIT_FAILURE);
+    }
+  uint8_t *aligned = (uint8_t *) SLAB_OF (p + SLAB_SIZE - 1);
+  if (aligned > p)
+    munmap (p, aligned - p);
+  munmap (aligned + SLAB_SIZE, p + SLAB_SIZE - aligned);
+
+  slab_t *s = (slab_t *) aligned;
+  s->used = 0;
+  s->free = NULL;
+  size_t i;
+  for (i = mm->per_slab; i > 0; i--)
     {
-      mm->clearf (p);
-      *(mm->stack) = (void *) p;
+      void *o = aligned + SLAB_START (mm) + (i - 1) * mm->osize;
+      mm->clearf (o);
+      LINK (mm, o) = s->free;
+      s->free = o;
     }
-  mm->stack--;
+  slab_link (&mm->partial, s);
+  mm->slabs++;
+  return s;
 }
 
-void mm_resize_stack (mmanager_t * mm)
+static void slab_release (mmanager_t * mm, slab_t * s)
 {
-  mm->size *= 2;
-  size_t count = mm->stack - mm->base;
-  mm->base = xrealloc (mm->base, mm->size * sizeof (void *));
-  mm->stack = mm->base + count;
+  slab_unlink (&mm->partial, s);
+  munmap (s, SLAB_SIZE);
+  mm->slabs--;
 }
 
-mmanager_t *mm_create (size_t osize, void (*clear_func) (void *o))
+mmanager_t *mm_create (char *name, size_t osize,
+		       void (*clear_func) (void *o))
 {
   mmanager_t *mm = xmalloc (sizeof (mmanager_t));
+  mm->name = name;
   mm->osize = osize;
   mm->clearf = clear_func;
-  mm->size = 1024;
-  mm->stack = mm->base = xmalloc (sizeof (void *) * mm->size);
-  mm_fill_stack (mm);
+  mm->partial = mm->full = NULL;
+  mm->slabs = mm->live = mm->peak = 0;
+  mm->high_water = mm_high_water;
+  mm->per_slab = (SLAB_SIZE - SLAB_START (mm)) / osize;
+  mm->next = mm_list;
+  mm_list = mm;
   return mm;
 }
 
 void mm_destroy (mmanager_t * mm)
 {
-  xfree (mm->stack);
+  while (mm->partial != NULL)
+    slab_release (mm, mm->partial);
+  while (mm->full != NULL)
+    {
+      slab_t *s = mm->full;
+      mm->full = s->next;
+      munmap (s, SLAB_SIZE);
+    }
+  mmanager_t **p = &mm_list;
+  while (*p != mm)
+    p = &(*p)->next;
+  *p = mm->next;
   xfree (mm);
 }
 
 void *mm_alloc (mmanager_t * mm)
 {
-  if (mm->stack == mm->base)
-    mm_fill_stack (mm);
-  void *p = *(mm->stack);
-  mm->stack--;
+  slab_t *s = mm->partial;
+  if (s == NULL)
+    s = slab_create (mm);
+  void *p = s->free;
+  s->free = LINK (mm, p);
+  s->used++;
+  if (s->free == NULL)
+    {
+      slab_unlink (&mm->partial, s);
+      slab_link (&mm->full, s);
+    }
+  if (++mm->live > mm->peak)
+    mm->peak = mm->live;
   return p;
 }
 
 void mm_free (mmanager_t * mm, void *o)
 {
-  mm->stack++;
-  if (mm->stack == mm->base + mm->size)
-    mm_resize_stack (mm);
-  *(mm->stack) = o;
+  slab_t *s = SLAB_OF (o);
   mm->clearf (o);
+  LINK (mm, o) = s->free;
+  s->free = o;
+  if (s->used-- == mm->per_slab)
+    {
+      slab_unlink (&mm->full, s);
+      slab_link (&mm->partial, s);
+    }
+  mm->live--;
+
+  /* Give empty slabs back once enough free space is sitting around. */
+  if (s->used == 0
+      && (mm->slabs * mm->per_slab - mm->live) * mm->osize > mm->high_water)
+    slab_release (mm, s);
 }
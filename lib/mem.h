@@ -1,21 +1,43 @@
-/* mem.h - generic obstack library */
+/* mem.h - generic slab allocator for fixed-size objects */
 #ifndef MEM_H
 #define MEM_H
 
 #include <stdlib.h>
 
+/* Slabs are aligned to their size so an object can find its slab. */
+#define SLAB_SIZE (64 * 1024)
+
+typedef struct slab
+{
+  struct slab *next, *prev;
+  void *free;			/* free objects in this slab */
+  size_t used;			/* objects handed out */
+} slab_t;
+
 typedef struct mmanager
 {
+  char *name;
   size_t osize;
-  void **stack, **base;
-  size_t size;
+  size_t per_slab;		/* objects per slab */
+  slab_t *partial;		/* slabs with free objects */
+  slab_t *full;			/* slabs with no free objects */
+  size_t slabs, live, peak;	/* statistics */
+  size_t high_water;		/* bytes of free objects kept around */
   void (*clearf) (void *o);
+  struct mmanager *next;	/* list of all memory managers */
 } mmanager_t;
 
+/* All of the memory managers, for gathering statistics. */
+extern mmanager_t *mm_list;
+
+/* Default for high_water of new memory managers. */
+extern size_t mm_high_water;
+
 /* Creates a new memory manager. */
-mmanager_t *mm_create (size_t osize, void (*clear_func) (void *o));
+mmanager_t *mm_create (char *name, size_t osize,
+		       void (*clear_func) (void *o));
 
-/* Free a memory manager */
+/* Free a memory manager and all of its slabs. */
 void mm_destroy (mmanager_t * mm);
 
 /* Allocate and free a new object */
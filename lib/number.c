@@ -1,67 +1,249 @@
 #include <stdio.h>
 #include <string.h>
 #include <stdlib.h>
+#include <errno.h>
+#include <limits.h>
+#include "common.h"
 #include "object.h"
 #include "number.h"
 
 object_t *c_ints (char *nstr)
 {
+  char *end;
+  errno = 0;
+  long n = strtol (nstr, &end, 10);
+  if (errno == 0 && *end == '\0')
+    return c_int (n);
+
+  /* Too big for a fixnum. */
   object_t *o = obj_create (INT);
-  mpz_t *z = OVAL (o);
+  mpz_t *z = OVAL (o) = xmalloc (sizeof (mpz_t));
   mpz_init (*z);
   mpz_set_str (*z, nstr, 10);
   return o;
 }
 
-object_t *c_int (int n)
+object_t *c_int (long n)
 {
   object_t *o = obj_create (INT);
-  mpz_t *z = OVAL (o);
-  mpz_init (*z);
-  mpz_set_ui (*z, n);
+  OFIX (o) = n;
+  return o;
+}
+
+object_t *c_mpz (mpz_t z)
+{
+  if (mpz_fits_slong_p (z))
+    return c_int (mpz_get_si (z));
+  object_t *o = obj_create (INT);
+  mpz_t *big = OVAL (o) = xmalloc (sizeof (mpz_t));
+  mpz_init_set (*big, z);
   return o;
 }
 
 object_t *c_floats (char *fstr)
+{
+  return c_float (strtod (fstr, NULL));
+}
+
+object_t *c_float (double d)
 {
   object_t *o = obj_create (FLOAT);
-  mpf_t *f = OVAL (o);
-  mpf_init2 (*f, 256);
-  mpf_set_str (*f, fstr, 10);
+  OFLO (o) = d;
   return o;
 }
 
-object_t *c_float (double d)
+/* Powers of ten that are exact doubles. */
+static const double pow10[] = {
+  1e0, 1e1, 1e2, 1e3, 1e4, 1e5, 1e6, 1e7, 1e8, 1e9, 1e10, 1e11,
+  1e12, 1e13, 1e14, 1e15, 1e16, 1e17, 1e18, 1e19, 1e20, 1e21, 1e22
+};
+
+#define DIGITP(c) ((c) >= '0' && (c) <= '9')
+
+object_t *c_number (char *str)
+{
+  char *p = str;
+  int neg = 0;
+  if (*p == '+' || *p == '-')
+    neg = *p++ == '-';
+
+  /* Integer part, accumulated until it overflows. */
+  unsigned long n = 0;
+  int digits = 0, over = 0;
+  for (; DIGITP (*p); p++, digits++)
+    {
+      unsigned d = *p - '0';
+      if (n > (ULONG_MAX - d) / 10)
+	over = 1;
+      else if (!over)
+	n = n * 10 + d;
+    }
+  if (*p == '\0' && digits > 0)
+    {
+      if (!over && n <= LONG_MAX)
+	return c_int (neg ? -(long) n : (long) n);
+      if (!over && neg && n == (unsigned long) LONG_MAX + 1)
+	return c_int (LONG_MIN);
+
+      /* Too big for a fixnum. */
+      object_t *o = obj_create (INT);
+      mpz_t *z = OVAL (o) = xmalloc (sizeof (mpz_t));
+      mpz_init_set_str (*z, str + (*str == '+'), 10);
+      return o;
+    }
+
+  /* Fraction and exponent. While the digits fit in a double's
+   * mantissa and the power of ten is exact, a single multiply or
+   * divide rounds correctly. */
+  int frac = 0;
+  if (*p == '.')
+    for (p++; DIGITP (*p); p++, frac++)
+      {
+	if (!over && n <= (ULONG_MAX - 9) / 10)
+	  n = n * 10 + (*p - '0');
+	else
+	  over = 1;
+      }
+  long exp = 0;
+  if (digits + frac > 0 && (*p == 'e' || *p == 'E'))
+    {
+      char *e = p + 1;
+      int eneg = 0;
+      if (*e == '+' || *e == '-')
+	eneg = *e++ == '-';
+      if (DIGITP (*e))
+	{
+	  for (; DIGITP (*e); e++)
+	    if (exp < 100000)
+	      exp = exp * 10 + (*e - '0');
+	  p = e;
+	  exp = eneg ? -exp : exp;
+	}
+    }
+  if (*p == '\0' && digits + frac > 0)
+    {
+      exp -= frac;
+      if (!over && n < (1UL << 53) && exp >= -22 && exp <= 22)
+	{
+	  double d = exp < 0 ? n / pow10[-exp] : n * pow10[exp];
+	  return c_float (neg ? -d : d);
+	}
+      return c_float (strtod (str, NULL));
+    }
+
+  /* Whatever else strtod() takes, such as inf, nan and hex floats. */
+  char c = str[*str == '+' || *str == '-'];
+  if (DIGITP (c) || (c != '\0' && strchr (".iInN", c) != NULL))
+    {
+      char *end;
+      double d = strtod (str, &end);
+      if (end != str && *end == '\0')
+	return c_float (d);
+    }
+  return NULL;
+}
+
+object_t *c_mpf (mpf_t f)
 {
   object_t *o = obj_create (FLOAT);
-  mpf_t *f = OVAL (o);
-  mpf_init2 (*f, 64);
-  mpf_set_d (*f, d);
+  mpf_t *big = OVAL (o) = xmalloc (sizeof (mpf_t));
+  mpf_init2 (*big, mpf_get_prec (f));
+  mpf_set (*big, f);
   return o;
 }
 
 int into2int (object_t * into)
 {
+  if (FIXP (into))
+    return OFIX (into);
   return mpz_get_si (DINT (into));
 }
 
+void into2mpz (object_t * into, mpz_t z)
+{
+  if (FIXP (into))
+    mpz_set_si (z, OFIX (into));
+  else
+    mpz_set (z, DINT (into));
+}
+
 double floato2float (object_t * floato)
 {
+  if (FLONUMP (floato))
+    return OFLO (floato);
   return mpf_get_d (DFLOAT (floato));
 }
 
+double numo2float (object_t * numo)
+{
+  if (FIXP (numo))
+    return OFIX (numo);
+  if (INTP (numo))
+    return mpz_get_d (DINT (numo));
+  return floato2float (numo);
+}
+
+char *flonum_format (char *buf, double d)
+{
+  /* Shortest representation that reads back as the same double. */
+  int prec;
+  for (prec = 1; prec < 17; prec++)
+    {
+      snprintf (buf, FLONUM_BUFLEN, "%.*g", prec, d);
+      if (strtod (buf, NULL) == d)
+	break;
+    }
+  if (prec == 17)
+    snprintf (buf, FLONUM_BUFLEN, "%.17g", d);
+
+  /* %g switches to an exponent for round numbers like 100, so only
+   * keep one for very large or small magnitudes. */
+  char *e = strchr (buf, 'e');
+  if (e != NULL)
+    {
+      int exp = atoi (e + 1);
+      if (exp > -16 && exp < 16)
+	snprintf (buf, FLONUM_BUFLEN, "%.*f",
+		  prec - 1 - exp > 0 ? prec - 1 - exp : 0, d);
+    }
+
+  /* Make sure the reader sees a float and not an integer. */
+  if (strpbrk (buf, ".eni") == NULL)
+    strcat (buf, ".0");
+  return buf;
+}
+
+/* Bignums never hold a value that fits in a fixnum, so hashing their
+ * limbs can't collide with the fixnum of the same value. */
 uint32_t int_hash (object_t * o)
 {
-  char *str = mpz_get_str (NULL, 16, DINT (o));
-  uint32_t h = hash (str, strlen (str));
-  free (str);
-  return h;
+  if (FIXP (o))
+    return word_hash (OFIX (o));
+  size_t n = mpz_size (DINT (o));
+  uint32_t h = hash ((void *) mpz_limbs_read (DINT (o)),
+		     n * sizeof (mp_limb_t));
+  return hash_combine (h, mpz_sgn (DINT (o)) < 0);
+}
+
+static uint32_t double_hash (double d)
+{
+  uint64_t bits;
+  if (d == 0)
+    d = 0;			/* -0.0 */
+  memcpy (&bits, &d, sizeof (bits));
+  return word_hash (bits);
 }
 
 uint32_t float_hash (object_t * o)
 {
-  char *str = mpf_get_str (NULL, NULL, 16, 0, DFLOAT (o));
-  uint32_t h = hash (str, strlen (str));
-  free (str);
-  return h;
+  /* Bigfloats that are exact doubles hash like the flonum, since
+   * they're eql. */
+  double d = floato2float (o);
+  if (FLONUMP (o) || mpf_cmp_d (DFLOAT (o), d) == 0)
+    return double_hash (d);
+
+  /* Otherwise the leading bits and the exponent are enough. */
+  long exp;
+  d = mpf_get_d_2exp (&exp, DFLOAT (o));
+  return hash_combine (double_hash (d), (uint32_t) exp);
 }
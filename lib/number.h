@@ -5,22 +5,47 @@
 #include "object.h"
 
 object_t *c_ints (char *n);
-object_t *c_int (int n);
+object_t *c_int (long n);
+object_t *c_mpz (mpz_t z);
 object_t *c_floats (char *f);
 object_t *c_float (double f);
+object_t *c_mpf (mpf_t f);
+
+/* Build the number written in str, reading the text once, or return
+ * NULL if it isn't a number. */
+object_t *c_number (char *str);
 
 /* get native numbers from number objects */
 int into2int (object_t * into);
+void into2mpz (object_t * into, mpz_t z);
 double floato2float (object_t * floato);
+double numo2float (object_t * numo);
 
+/* Integers are stored inline as fixnums when they fit in a long and
+ * only use a GMP bignum, pointed to by OVAL, when they don't. Floats
+ * are inline doubles (flonums) unless explicitly created as GMP
+ * arbitrary precision bigfloats. */
 #define OINT(o) ((mpz_t *) OVAL(o))
 #define OFLOAT(o) ((mpf_t *) OVAL(o))
 #define DINT(o) (*((mpz_t *) OVAL(o)))
 #define DFLOAT(o) (*((mpf_t *) OVAL(o)))
+#define OFIX(o) ((o)->uval.num.n.fix)
+#define OFLO(o) ((o)->uval.num.n.flo)
 
 #define INTP(o) (o->type == INT)
 #define FLOATP(o) (o->type == FLOAT)
 #define NUMP(o) (INTP (o) || FLOATP (o))
+#define FIXP(o) (INTP (o) && OVAL (o) == NULL)
+#define BIGP(o) (INTP (o) && OVAL (o) != NULL)
+#define FLONUMP(o) (FLOATP (o) && OVAL (o) == NULL)
+#define BIGFLOATP(o) (FLOATP (o) && OVAL (o) != NULL)
+
+/* Format a double into buf so that it reads back exactly. */
+#define FLONUM_BUFLEN 48
+char *flonum_format (char *buf, double d);
+
+/* Default precision, in bits, of new bigfloats. */
+#define BIGFLOAT_PREC 256
 
 uint32_t int_hash (object_t * o);
 uint32_t float_hash (object_t * o);
@@ -10,13 +10,30 @@
 #include "number.h"
 #include "vector.h"
 #include "detach.h"
+#include "hashtable.h"
+#include "printer.h"
+#include "port.h"
+#include "cycle.h"
+#include "vm.h"
+#include "eval.h"
 
 static mmanager_t *mm;
 
+/* Object statistics */
+size_t type_live[TYPE_COUNT], type_peak[TYPE_COUNT];
+char *type_names[TYPE_COUNT] = {
+  "int", "float", "string", "symbol", "cons", "vector", "cfunc",
+  "special", "detach", "hash-table", "closure", "port"
+};
+
 static void object_clear (void *o)
 {
   object_t *obj = (object_t *) o;
   obj->type = SYMBOL;
+  obj->color = CC_BLACK;
+  obj->buffered = 0;
+  obj->code = 0;
+  obj->expanded = 0;
   obj->refs = 0;
   FVAL (obj) = NULL;
   OVAL (obj) = NIL;
@@ -24,7 +41,7 @@ static void object_clear (void *o)
 
 void object_init ()
 {
-  mm = mm_create (sizeof (object_t), &object_clear);
+  mm = mm_create ("object", sizeof (object_t), &object_clear);
 }
 
 object_t *obj_create (type_t type)
@@ -32,16 +49,27 @@ object_t *obj_create (type_t type)
   object_t *o = (object_t *) mm_alloc (mm);
   o->type = type;
   o->refs++;
+  if (++type_live[type] > type_peak[type])
+    type_peak[type] = type_live[type];
   switch (type)
     {
     case INT:
-      OVAL (o) = xmalloc (sizeof (mpz_t));
+      /* Starts as fixnum zero, see c_mpz() for bignums. */
+      OVAL (o) = NULL;
+      OFIX (o) = 0;
       break;
     case FLOAT:
-      OVAL (o) = xmalloc (sizeof (mpf_t));
+      /* Starts as flonum zero, see c_mpf() for bigfloats. */
+      OVAL (o) = NULL;
+      OFLO (o) = 0;
       break;
     case CONS:
-      OVAL (o) = cons_create ();
+      CAR (o) = NIL;
+      CDR (o) = NIL;
+      break;
+    case CLOSURE:
+      CLOSURE_FN (o) = NIL;
+      CLOSURE_ENV (o) = NIL;
       break;
     case SYMBOL:
       OVAL (o) = symbol_create ();
@@ -50,11 +78,18 @@ object_t *obj_create (type_t type)
       OVAL (o) = str_create ();
       break;
     case VECTOR:
-      OVAL (o) = vector_create ();
+      OVEC (o)->v = NULL;
+      VLENGTH (o) = 0;
       break;
     case DETACH:
       OVAL (o) = detach_create ();
       break;
+    case HASHTABLE:
+      OVAL (o) = hashtable_create ();
+      break;
+    case PORT:
+      OVAL (o) = port_create ();
+      break;
     case CFUNC:
     case SPECIAL:
       break;
@@ -74,6 +109,16 @@ object_t *c_cfunc (cfunc_t f)
 {
   object_t *o = obj_create (CFUNC);
   FVAL (o) = f;
+  CFUNC_MIN (o) = -1;
+  return o;
+}
+
+object_t *c_vfunc (vfunc_t f, int min, int max)
+{
+  object_t *o = obj_create (CFUNC);
+  VFVAL (o) = f;
+  CFUNC_MIN (o) = min;
+  CFUNC_MAX (o) = max;
   return o;
 }
 
@@ -84,14 +129,56 @@ object_t *c_special (cfunc_t f)
   return o;
 }
 
+object_t *c_closure (object_t * fn, object_t * env)
+{
+  object_t *o = obj_create (CLOSURE);
+  CLOSURE_FN (o) = fn;
+  CLOSURE_ENV (o) = env;
+  return o;
+}
+
+/* Objects whose count reached zero, waiting to be released. */
+static object_t **pending = NULL;
+static size_t pending_size = 0;
+static int draining = 0;
+size_t destroy_pending = 0;
+size_t destroy_budget = 0;
+
+static void obj_release (object_t * o);
+
 void obj_destroy (object_t * o)
 {
   if (SYMBOLP (o))
     return;
   o->refs--;
   if (o->refs > 0)
-    return;
+    {
+      if (CONTAINERP (o))
+	cycle_candidate (o);
+      return;
+    }
 
+  /* Queue it rather than recursing into its children. */
+  if (!draining && destroy_budget == 0)
+    {
+      draining = 1;
+      obj_release (o);
+      draining = 0;
+      if (destroy_pending > 0)
+	obj_reclaim (0);
+      return;
+    }
+  if (destroy_pending == pending_size)
+    {
+      pending_size = pending_size ? pending_size * 2 : 1024;
+      pending = xrealloc (pending, pending_size * sizeof (object_t *));
+    }
+  pending[destroy_pending++] = o;
+}
+
+/* Drop an object's references and free it. */
+static void obj_release (object_t * o)
+{
   mpz_t *z;
   mpf_t *f;
   switch (o->type)
@@ -100,11 +187,15 @@ void obj_destroy (object_t * o)
       /* Symbol objects are never destroyed. */
       return;
     case FLOAT:
+      if (FLONUMP (o))
+	break;
       f = OFLOAT (o);
       mpf_clear (*f);
       xfree (OVAL (o));
       break;
     case INT:
+      if (FIXP (o))
+	break;
       z = OINT (o);
       mpz_clear (*z);
       xfree (OVAL (o));
@@ -115,83 +206,90 @@ void obj_destroy (object_t * o)
     case CONS:
       obj_destroy (CAR (o));
       obj_destroy (CDR (o));
-      cons_destroy (OVAL (o));
+      CAR (o) = CDR (o) = NIL;
+      break;
+    case CLOSURE:
+      obj_destroy (CLOSURE_FN (o));
+      obj_destroy (CLOSURE_ENV (o));
+      CLOSURE_FN (o) = CLOSURE_ENV (o) = NIL;
       break;
     case VECTOR:
-      vector_destroy (OVAL (o));
+      vector_destroy (o);
       break;
     case DETACH:
       detach_destroy (o);
       xfree (OVAL (o));
       break;
+    case HASHTABLE:
+      hashtable_destroy (o);
+      xfree (OVAL (o));
+      break;
+    case PORT:
+      port_destroy (o);
+      xfree (OVAL (o));
+      break;
     case CFUNC:
     case SPECIAL:
       break;
     }
-  mm_free (mm, (void *) o);
+
+  /* The cycle collector still has a pointer and will free it. */
+  if (o->buffered)
+    {
+      o->color = CC_BLACK;
+      return;
+    }
+  obj_free (o);
 }
 
-void obj_print (object_t * o, int newline)
+size_t obj_reclaim (size_t max)
 {
-  switch (o->type)
+  size_t count = 0;
+  draining = 1;
+  while (destroy_pending > 0 && (max == 0 || count < max))
     {
-    case CONS:
-      printf ("(");
-      object_t *p = o;
-      while (p->type == CONS)
-	{
-	  obj_print (CAR (p), 0);
-	  p = CDR (p);
-	  if (p->type == CONS)
-	    printf (" ");
-	}
-      if (p != NIL)
-	{
-	  printf (" . ");
-	  obj_print (p, 0);
-	}
-      printf (")");
-      break;
-    case INT:
-      gmp_printf ("%Zd", OINT (o));
-      break;
-    case FLOAT:
-      gmp_printf ("%.Ff", OFLOAT (o));
-      break;
-    case STRING:
-      printf ("%s", OSTRP (o));
-      break;
-    case SYMBOL:
-      printf ("%s", ((symbol_t *) OVAL (o))->name);
-      break;
-    case VECTOR:
-      vec_print (o);
-      break;
-    case DETACH:
-      detach_print (o);
-      break;
-    case CFUNC:
-      /* It's not possible to print a function pointer. */
-      printf ("<cfunc>");
-      break;
-    case SPECIAL:
-      /* It's not possible to print a function pointer. */
-      printf ("<special form>");
-      break;
-    default:
-      printf ("ERROR");
+      obj_release (pending[--destroy_pending]);
+      count++;
     }
+  draining = 0;
+  return count;
+}
+
+void obj_free (object_t * o)
+{
+  if (o->code)
+    {
+      if (o->expanded)
+	expansion_forget (o);
+      else
+	code_forget (o);
+    }
+  type_live[o->type]--;
+  mm_free (mm, (void *) o);
+}
 
+void obj_print (object_t * o, int newline)
+{
+  static printer_t *out = NULL;
+  if (out == NULL)
+    out = printer_create (stdout, -1);
+  obj_write (out, o);
   if (newline)
-    printf ("\n");
+    printer_putc (out, '\n');
+  printer_flush (out);
 }
 
 uint32_t obj_hash (object_t * o)
+{
+  return obj_hash_depth (o, 0);
+}
+
+uint32_t obj_hash_depth (object_t * o, int depth)
 {
   switch (o->type)
     {
     case CONS:
-      return cons_hash (o);
+      return cons_hash (o, depth);
     case INT:
       return int_hash (o);
       break;
@@ -205,15 +303,19 @@ uint32_t obj_hash (object_t * o)
       return symbol_hash (o);
       break;
     case VECTOR:
-      return vector_hash (o);
+      return vector_hash (o, depth);
       break;
     case DETACH:
       return detach_hash (o);
       break;
+    case HASHTABLE:
+    case CLOSURE:
+    case PORT:
+      return word_hash ((uintptr_t) o);
+      break;
     case CFUNC:
     case SPECIAL:
-      /* Imprecise, but close enough */
-      return hash (OVAL (o), sizeof (void *));
+      return word_hash ((uintptr_t) OVAL (o));
       break;
     }
   return 0;
@@ -221,16 +323,5 @@ uint32_t obj_hash (object_t * o)
 
 uint32_t hash (void *key, size_t keylen)
 {
-  /* One-at-a-time hash */
-  uint32_t hash, i;
-  for (hash = 0, i = 0; i < keylen; ++i)
-    {
-      hash += ((char *) key)[i];
-      hash += (hash << 10);
-      hash ^= (hash >> 6);
-    }
-  hash += (hash << 3);
-  hash ^= (hash >> 11);
-  hash += (hash << 15);
-  return hash;
+  return mem_hash (key, keylen);
 }
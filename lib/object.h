@@ -3,27 +3,81 @@
 #define OBJECT_H
 
 #include <stdint.h>
+#include <stddef.h>
 
 typedef enum types
-{ INT, FLOAT, STRING, SYMBOL, CONS, VECTOR, CFUNC, SPECIAL, DETACH } type_t;
+{ INT, FLOAT, STRING, SYMBOL, CONS, VECTOR, CFUNC, SPECIAL, DETACH,
+  HASHTABLE, CLOSURE, PORT
+} type_t;
+
+/* Number of types, update along with type_t. */
+#define TYPE_COUNT (PORT + 1)
+
+/* Cons cells and vector headers live directly inside the object. */
+struct cons
+{
+  struct object *car;
+  struct object *cdr;
+};
+
+struct vector
+{
+  struct object **v;
+  size_t len;
+};
 
 typedef union obval
 {
   void *val;
   struct object *(*fval) (struct object *);
+  struct
+  {
+    void *big;			/* aliases val, NULL for inline numbers */
+    union
+    {
+      long fix;
+      double flo;
+    } n;
+  } num;
+  struct cons cons;
+  struct vector vec;
+  struct
+  {
+    union
+    {
+      struct object *(*list) (struct object *);	/* aliases fval */
+      struct object *(*vec) (int, struct object **);
+    } f;
+    int min, max;		/* arity of vec, min is -1 for list */
+  } cfunc;
 } obval_t;
 
+/* Bits available in the header for a compiled code index. */
+#define CODE_BITS 20
+
 typedef struct object
 {
-  type_t type;
+  type_t type:8;
+  unsigned int color:2;		/* cycle collector state */
+  unsigned int buffered:1;	/* in cycle collector root buffer */
+  unsigned int code:CODE_BITS;	/* compiled code index, see vm.h */
+  unsigned int expanded:1;	/* code indexes macro expansions instead */
   unsigned int refs;
   obval_t uval;
 } object_t;
 
 typedef object_t *(*cfunc_t) (object_t *);
 
+/* Builtins may instead take their arguments as an array, which they
+ * must not keep or modify. When asked for a doc-string, argv is NULL. */
+typedef object_t *(*vfunc_t) (int argc, object_t ** argv);
+
 #define OVAL(o) ((o)->uval.val)
 #define FVAL(o) ((o)->uval.fval)
+#define VFVAL(o) ((o)->uval.cfunc.f.vec)
+#define CFUNC_MIN(o) ((o)->uval.cfunc.min)
+#define CFUNC_MAX(o) ((o)->uval.cfunc.max)
+#define VFUNCP(o) ((o)->type == CFUNC && CFUNC_MIN (o) >= 0)
 
 /* Must be called before any other functions. */
 void object_init ();
@@ -35,16 +89,45 @@ void obj_print (object_t * o, int newline);
 object_t *obj_create (type_t type);
 object_t *c_cons (object_t * car, object_t * cdr);
 object_t *c_cfunc (cfunc_t f);
+object_t *c_vfunc (vfunc_t f, int min, int max);	/* max -1 for any */
 object_t *c_special (cfunc_t f);
+object_t *c_closure (object_t * fn, object_t * env);
 void obj_destroy (object_t * o);
 
-/* object hash functions */
+/* Return object memory to the pool without touching its contents. */
+void obj_free (object_t * o);
+
+/* Objects are released from a worklist rather than recursively. With
+ * a non-zero destroy_budget, releasing is left to eval(), which frees
+ * at most that many objects per step to bound pause times. */
+extern size_t destroy_pending, destroy_budget;
+size_t obj_reclaim (size_t max);
+#define DESTROY_CHECK() if (destroy_pending > 0) \
+                          obj_reclaim (destroy_budget);
+
+/* Live and peak object counts by type, and type names. */
+extern size_t type_live[TYPE_COUNT], type_peak[TYPE_COUNT];
+extern char *type_names[TYPE_COUNT];
+
+/* object hash functions. Lists and vectors are hashed by at most
+ * HASH_LENGTH elements, HASH_DEPTH levels deep, which bounds the cost
+ * and is enough to tell most of them apart. */
+#define HASH_LENGTH 7
+#define HASH_DEPTH 3
 uint32_t obj_hash (object_t * o);
+uint32_t obj_hash_depth (object_t * o, int depth);
 uint32_t hash (void *buf, size_t buflen);
 
 #define STRINGP(o) (o->type == STRING)
 #define SYMBOLP(o) (o->type == SYMBOL)
 #define CONSP(o) (o->type == CONS)
+#define CLOSUREP(o) ((o)->type == CLOSURE)
+
+/* A closure is laid out like a cons of the (params . body) cons its
+ * code is compiled from and the environment frame it was made in.
+ * Frames are vectors whose slot 0 holds the enclosing frame, or nil. */
+#define CLOSURE_FN(o) ((o)->uval.cons.car)
+#define CLOSURE_ENV(o) ((o)->uval.cons.cdr)
 
 #define UPREF(o) ((o)->refs++, o)
 
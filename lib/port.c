@@ -0,0 +1,240 @@
+/* port.c - buffered file input and output */
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include "common.h"
+#include "object.h"
+#include "symtab.h"
+#include "eval.h"
+#include "str.h"
+#include "number.h"
+#include "reader.h"
+#include "printer.h"
+#include "port.h"
+
+/* Output ports to flush at exit. */
+static port_t *outputs = NULL;
+
+static void flush_outputs ()
+{
+  port_t *port;
+  for (port = outputs; port != NULL; port = port->next)
+    if (port->owner == getpid ())
+      printer_flush (port->write);
+}
+
+port_t *port_create ()
+{
+  port_t *port = xmalloc (sizeof (port_t));
+  port->name = NULL;
+  port->fid = NULL;
+  port->read = NULL;
+  port->write = NULL;
+  port->owner = getpid ();
+  port->prev = port->next = NULL;
+  return port;
+}
+
+/* Close the port, returning non-zero if buffered output couldn't be
+ * written out. */
+static int port_close (port_t * port)
+{
+  int error = 0;
+  if (port->read != NULL)
+    {
+      reader_destroy (port->read);
+      fclose (port->fid);
+      port->read = NULL;
+      port->fid = NULL;
+    }
+  if (port->write != NULL)
+    {
+      int fd = port->write->fd;
+      printer_flush (port->write);
+      error = port->write->error;
+      printer_destroy (port->write);
+      port->write = NULL;
+      if (port->prev != NULL)
+	port->prev->next = port->next;
+      else
+	outputs = port->next;
+      if (port->next != NULL)
+	port->next->prev = port->prev;
+      if (close (fd) != 0)
+	error = 1;
+    }
+  return error;
+}
+
+void port_destroy (object_t * o)
+{
+  port_t *port = OPORT (o);
+  port_close (port);
+  xfree (port->name);
+}
+
+void port_print (printer_t * p, object_t * o)
+{
+  port_t *port = OPORT (o);
+  printer_puts (p, "<port ");
+  printer_puts (p, port->name);
+  printer_putc (p, '>');
+}
+
+/* Attachment for errors from the system: the file name and why. */
+static object_t *file_error_info (object_t * name)
+{
+  return c_cons (UPREF (name),
+		 c_cons (c_strs (xstrdup (strerror (errno))), NIL));
+}
+
+static object_t *c_port (char *name)
+{
+  object_t *o = obj_create (PORT);
+  OPORT (o)->name = xstrdup (name);
+  return o;
+}
+
+/* lisp-space functions */
+
+object_t *lisp_open_input_file (int argc, object_t ** argv)
+{
+  VDOC ("Open a file for reading, returning a port.");
+  object_t *name = argv[0];
+  if (!STRINGP (name))
+    THROW (wrong_type, UPREF (name));
+  FILE *fid = fopen (OSTR (name), "r");
+  if (fid == NULL)
+    THROW (file_error, file_error_info (name));
+  object_t *o = c_port (OSTR (name));
+  port_t *port = OPORT (o);
+  port->fid = fid;
+  port->read = reader_create (fid, NULL, port->name, 0);
+  port->read->shebang = 0;
+  return o;
+}
+
+object_t *lisp_open_output_file (int argc, object_t ** argv)
+{
+  VDOC ("Create or truncate a file for writing, returning a port.");
+  object_t *name = argv[0];
+  if (!STRINGP (name))
+    THROW (wrong_type, UPREF (name));
+  int fd = open (OSTR (name), O_WRONLY | O_CREAT | O_TRUNC, 0666);
+  if (fd < 0)
+    THROW (file_error, file_error_info (name));
+  static int registered = 0;
+  if (!registered)
+    registered = atexit (&flush_outputs) == 0;
+  object_t *o = c_port (OSTR (name));
+  port_t *port = OPORT (o);
+  port->write = printer_create (NULL, fd);
+  port->next = outputs;
+  if (outputs != NULL)
+    outputs->prev = port;
+  outputs = port;
+  return o;
+}
+
+object_t *lisp_close_port (int argc, object_t ** argv)
+{
+  VDOC ("Close a port, writing out any buffered output.");
+  object_t *o = argv[0];
+  if (!PORTP (o))
+    THROW (wrong_type, UPREF (o));
+  if (port_close (OPORT (o)) != 0)
+    THROW (file_error, c_strs (xstrdup (OPORT (o)->name)));
+  return T;
+}
+
+/* Return the port's reader, or NULL if it isn't an open input port. */
+static reader_t *input_of (object_t * o)
+{
+  if (!PORTP (o))
+    return NULL;
+  return OPORT (o)->read;
+}
+
+static printer_t *output_of (object_t * o)
+{
+  if (!PORTP (o))
+    return NULL;
+  return OPORT (o)->write;
+}
+
+object_t *lisp_read_line (int argc, object_t ** argv)
+{
+  VDOC ("Return the next line from an input port as a string, without "
+	"its newline, or nil at the end of the file.");
+  reader_t *r = input_of (argv[0]);
+  if (r == NULL)
+    THROW (wrong_type, UPREF (argv[0]));
+  object_t *line = read_line (r);
+  return line ? line : NIL;
+}
+
+object_t *lisp_read_bytes (int argc, object_t ** argv)
+{
+  VDOC ("Return a string of up to n bytes from an input port, or nil at "
+	"the end of the file.");
+  object_t *n = argv[0];
+  reader_t *r = input_of (argv[1]);
+  if (!INTP (n) || !FIXP (n) || OFIX (n) < 0)
+    THROW (wrong_type, UPREF (n));
+  if (r == NULL)
+    THROW (wrong_type, UPREF (argv[1]));
+  size_t len = OFIX (n);
+  char *str = xmalloc (len + 1);
+  size_t got = read_bytes (r, str, len);
+  if (got == 0 && len > 0)
+    {
+      xfree (str);
+      return NIL;
+    }
+  if (got < len)
+    str = xrealloc (str, got + 1);
+  str[got] = '\0';
+  return c_str (str, got);
+}
+
+object_t *lisp_read (int argc, object_t ** argv)
+{
+  VDOC ("Read the next object from an input port. At the end of the "
+	"file, return the optional second argument.");
+  reader_t *r = input_of (argv[0]);
+  if (r == NULL)
+    THROW (wrong_type, UPREF (argv[0]));
+  object_t *o = read_sexp (r);
+  if (o == err_symbol)
+    THROW (parse_error, c_strs (xstrdup (r->name)));
+  if (r->eof && o == NIL)
+    return argc > 1 ? UPREF (argv[1]) : NIL;
+  return o;
+}
+
+object_t *lisp_write (int argc, object_t ** argv)
+{
+  VDOC ("Write an object to an output port as print would.");
+  printer_t *p = output_of (argv[1]);
+  if (p == NULL)
+    THROW (wrong_type, UPREF (argv[1]));
+  obj_write (p, argv[0]);
+  printer_putc (p, '\n');
+  return NIL;
+}
+
+object_t *lisp_write_string (int argc, object_t ** argv)
+{
+  VDOC ("Write the contents of a string to an output port.");
+  object_t *str = argv[0];
+  printer_t *p = output_of (argv[1]);
+  if (!STRINGP (str))
+    THROW (wrong_type, UPREF (str));
+  if (p == NULL)
+    THROW (wrong_type, UPREF (argv[1]));
+  printer_write (p, OSTR (str), OSTRLEN (str));
+  return NIL;
+}
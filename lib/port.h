@@ -0,0 +1,45 @@
+#ifndef PORT_H
+#define PORT_H
+
+#include <stdio.h>
+#include <unistd.h>
+#include "object.h"
+#include "reader.h"
+#include "printer.h"
+
+/* A port reads from or writes to a file through a large buffer. Input
+ * goes through a reader, so lines, bytes and s-expressions can be
+ * mixed, and output through a printer. A port is closed when it is
+ * destroyed, if close-port hasn't already done so, and output ports
+ * still open when the process exits are flushed. */
+typedef struct port
+{
+  char *name;
+  FILE *fid;			/* input file, NULL when closed */
+  reader_t *read;
+  printer_t *write;		/* NULL when closed */
+  pid_t owner;			/* process that opened it */
+  struct port *prev, *next;	/* open output ports */
+} port_t;
+
+/* Creation and destruction */
+port_t *port_create ();
+void port_destroy (object_t * o);
+
+/* Basic type functions */
+void port_print (printer_t * p, object_t * o);
+
+/* lisp-space functions */
+object_t *lisp_open_input_file (int argc, object_t ** argv);
+object_t *lisp_open_output_file (int argc, object_t ** argv);
+object_t *lisp_close_port (int argc, object_t ** argv);
+object_t *lisp_read_line (int argc, object_t ** argv);
+object_t *lisp_read_bytes (int argc, object_t ** argv);
+object_t *lisp_read (int argc, object_t ** argv);
+object_t *lisp_write (int argc, object_t ** argv);
+object_t *lisp_write_string (int argc, object_t ** argv);
+
+#define OPORT(o) ((port_t *) OVAL (o))
+#define PORTP(o) ((o)->type == PORT)
+
+#endif /* PORT_H */
@@ -0,0 +1,235 @@
+/* printer.c - buffered output for printing objects */
+#include <stdio.h>
+#include <string.h>
+#include <errno.h>
+#include <unistd.h>
+#include <gmp.h>
+#include "common.h"
+#include "object.h"
+#include "cons.h"
+#include "symtab.h"
+#include "str.h"
+#include "number.h"
+#include "vector.h"
+#include "hashtable.h"
+#include "detach.h"
+#include "port.h"
+#include "printer.h"
+
+/* Output is written out once this much has built up. */
+#define PRINTER_BLOCK 65536
+
+printer_t *printer_create (FILE * fid, int fd)
+{
+  printer_t *p = xmalloc (sizeof (printer_t));
+  p->size = 256;
+  p->len = 0;
+  p->buf = xmalloc (p->size);
+  p->fid = fid;
+  p->fd = fd;
+  p->error = 0;
+  return p;
+}
+
+void printer_destroy (printer_t * p)
+{
+  printer_flush (p);
+  xfree (p->buf);
+  xfree (p);
+}
+
+void printer_flush (printer_t * p)
+{
+  if (p->fid != NULL)
+    {
+      if (fwrite (p->buf, 1, p->len, p->fid) != p->len)
+	p->error = 1;
+      p->len = 0;
+    }
+  else if (p->fd >= 0)
+    {
+      char *s = p->buf;
+      while (s < p->buf + p->len)
+	{
+	  ssize_t n = write (p->fd, s, p->buf + p->len - s);
+	  if (n < 0 && errno == EINTR)
+	    continue;
+	  if (n <= 0)
+	    {
+	      p->error = 1;
+	      break;
+	    }
+	  s += n;
+	}
+      p->len = 0;
+    }
+}
+
+void printer_write (printer_t * p, char *str, size_t len)
+{
+  if (p->len + len > p->size)
+    {
+      if (p->fid != NULL || p->fd >= 0)
+	{
+	  if (p->len >= PRINTER_BLOCK)
+	    printer_flush (p);
+	  if (len >= PRINTER_BLOCK)
+	    {
+	      /* Large enough to write out directly. */
+	      char *buf = p->buf;
+	      size_t size = p->size;
+	      printer_flush (p);
+	      p->buf = str;
+	      p->len = p->size = len;
+	      printer_flush (p);
+	      p->buf = buf;
+	      p->size = size;
+	      return;
+	    }
+	}
+      while (p->len + len > p->size)
+	p->size *= 2;
+      p->buf = xrealloc (p->buf, p->size);
+    }
+  memcpy (p->buf + p->len, str, len);
+  p->len += len;
+}
+
+void printer_puts (printer_t * p, char *str)
+{
+  printer_write (p, str, strlen (str));
+}
+
+void printer_putc (printer_t * p, char c)
+{
+  if (p->len == p->size)
+    printer_write (p, &c, 1);
+  else
+    p->buf[p->len++] = c;
+}
+
+object_t *printer_string (printer_t * p)
+{
+  char *str = xmalloc (p->len + 1);
+  memcpy (str, p->buf, p->len);
+  str[p->len] = '\0';
+  object_t *o = c_str (str, p->len);
+  p->len = 0;
+  return o;
+}
+
+static void print_fixnum (printer_t * p, long n)
+{
+  char buf[24], *s = buf + sizeof (buf);
+  unsigned long u = n < 0 ? -(unsigned long) n : (unsigned long) n;
+  do
+    {
+      *--s = '0' + u % 10;
+      u /= 10;
+    }
+  while (u != 0);
+  if (n < 0)
+    *--s = '-';
+  printer_write (p, s, buf + sizeof (buf) - s);
+}
+
+/* Print a string in quotes, escaping quotes and backslashes. */
+static void print_string (printer_t * p, object_t * o)
+{
+  char *s = OSTR (o), *end = s + OSTRLEN (o);
+  printer_putc (p, '"');
+  while (s < end)
+    {
+      char *run = s;
+      while (s < end && *s != '"' && *s != '\\')
+	s++;
+      printer_write (p, run, s - run);
+      if (s < end)
+	{
+	  printer_putc (p, '\\');
+	  printer_putc (p, *s++);
+	}
+    }
+  printer_putc (p, '"');
+}
+
+void obj_write (printer_t * p, object_t * o)
+{
+  char *str;
+  switch (o->type)
+    {
+    case CONS:
+      printer_putc (p, '(');
+      while (1)
+	{
+	  obj_write (p, CAR (o));
+	  o = CDR (o);
+	  if (!CONSP (o))
+	    break;
+	  printer_putc (p, ' ');
+	}
+      if (o != NIL)
+	{
+	  printer_puts (p, " . ");
+	  obj_write (p, o);
+	}
+      printer_putc (p, ')');
+      break;
+    case INT:
+      if (FIXP (o))
+	print_fixnum (p, OFIX (o));
+      else
+	{
+	  str = mpz_get_str (NULL, 10, DINT (o));
+	  printer_puts (p, str);
+	  xfree (str);
+	}
+      break;
+    case FLOAT:
+      if (FLONUMP (o))
+	{
+	  char buf[FLONUM_BUFLEN];
+	  printer_puts (p, flonum_format (buf, OFLO (o)));
+	}
+      else
+	{
+	  gmp_asprintf (&str, "%.Ff", DFLOAT (o));
+	  printer_puts (p, str);
+	  xfree (str);
+	}
+      break;
+    case STRING:
+      print_string (p, o);
+      break;
+    case SYMBOL:
+      printer_puts (p, SYMNAME (o));
+      break;
+    case VECTOR:
+      vec_print (p, o);
+      break;
+    case DETACH:
+      detach_print (p, o);
+      break;
+    case HASHTABLE:
+      hashtable_print (p, o);
+      break;
+    case CLOSURE:
+      printer_puts (p, "<closure ");
+      obj_write (p, CAR (CLOSURE_FN (o)));
+      printer_putc (p, '>');
+      break;
+    case PORT:
+      port_print (p, o);
+      break;
+    case CFUNC:
+      /* It's not possible to print a function pointer. */
+      printer_puts (p, "<cfunc>");
+      break;
+    case SPECIAL:
+      /* It's not possible to print a function pointer. */
+      printer_puts (p, "<special form>");
+      break;
+    default:
+      printer_puts (p, "ERROR");
+    }
+}
@@ -0,0 +1,37 @@
+/* printer.h - buffered output for printing objects */
+#ifndef PRINTER_H
+#define PRINTER_H
+
+#include <stdio.h>
+#include "object.h"
+
+/* Output collects in buf and is written to the printer's file, or
+ * file descriptor, in large blocks. A printer with neither keeps it
+ * all in memory. */
+typedef struct printer
+{
+  char *buf;
+  size_t len, size;
+  FILE *fid;
+  int fd;			/* -1 if none */
+  int error;			/* a write failed */
+} printer_t;
+
+printer_t *printer_create (FILE * fid, int fd);
+void printer_destroy (printer_t * p);
+
+void printer_write (printer_t * p, char *str, size_t len);
+void printer_puts (printer_t * p, char *str);
+void printer_putc (printer_t * p, char c);
+
+/* Write out everything buffered so far, if there's somewhere to. */
+void printer_flush (printer_t * p);
+
+/* Return the buffered output as a string object, emptying the
+ * printer. */
+object_t *printer_string (printer_t * p);
+
+/* Print an object, as obj_print() does to stdout. */
+void obj_write (printer_t * p, object_t * o);
+
+#endif /* PRINTER_H */
@@ -1,6 +1,7 @@
 #include <stdio.h>
 #include <string.h>
 #include <errno.h>
+#include <unistd.h>
 #include "object.h"
 #include "symtab.h"
 #include "common.h"
@@ -10,6 +11,7 @@
 #include "reader.h"
 #include "number.h"
 #include "vector.h"
+#include "fasl.h"
 
 static void read_error (reader_t * r, char *str);
 static void addpop (reader_t * r);
@@ -19,14 +21,38 @@ char *wisproot = NULL;
 
 char *atom_chars =
   "ABCDEFGHIJKLMNOPQRSTUVWXYZabcdefghijklmnopqrstuvwxyz"
-  "0123456789!#$%^&*-_=+|\\/?.~<>";
+  "0123456789!#$%^&*-_=+|\\/?.~<>:";
 char *prompt = "wisp> ";
 
+/* Bytes read from a file at a time. */
+#define READ_BLOCK 65536
+
+/* Character classes, looked up instead of searching strings of
+ * characters for each byte read. */
+#define CC_ATOM   1		/* allowed in a symbol */
+#define CC_DELIM  2		/* ends an atom */
+#define CC_ESCAPE 4		/* escapes the next character */
+
+static unsigned char char_class[256];
+
+static void init_char_class ()
+{
+  char *p;
+  for (p = atom_chars; *p; p++)
+    char_class[(unsigned char) *p] |= CC_ATOM;
+  for (p = " \t\r\n()[];"; *p; p++)
+    char_class[(unsigned char) *p] |= CC_DELIM;
+  char_class[0] |= CC_DELIM;
+  char_class['\\'] |= CC_ESCAPE;
+}
+
 reader_t *reader_create (FILE * fid, char *str, char *name, int interactive)
 {
+  if (char_class['('] == 0)
+    init_char_class ();
   reader_t *r = xmalloc (sizeof (reader_t));
   r->fid = fid;
-  r->strp = r->str = str;
+  r->str = str;
   r->name = name ? name : "<unknown>";
   r->interactive = interactive;
   r->prompt = prompt;
@@ -36,6 +62,16 @@ reader_t *reader_create (FILE * fid, char *str, char *name, int interactive)
   r->shebang = -1 + interactive;
   r->done = 0;
 
+  /* input */
+  if (str != NULL)
+    {
+      r->in = NULL;
+      r->inp = str;
+      r->inend = str + strlen (str);
+    }
+  else
+    r->inp = r->inend = r->in = xmalloc (READ_BLOCK);
+
   /* read buffers */
   r->buflen = 1024;
   r->bufp = r->buf = xmalloc (r->buflen + 1);
@@ -51,33 +87,41 @@ reader_t *reader_create (FILE * fid, char *str, char *name, int interactive)
 void reader_destroy (reader_t * r)
 {
   reset (r);
+  xfree (r->in);
   xfree (r->buf);
   xfree (r->readbuf);
   xfree (r->base);
   xfree (r);
 }
 
+/* Read the next block of input, returning 0 at the end. This takes
+ * whatever is available rather than waiting for a full block, since
+ * the other end of a pipe may be waiting on a reply. */
+static int reader_fill (reader_t * r)
+{
+  ssize_t n;
+  if (r->in == NULL)
+    return 0;
+  if (r->interactive)
+    fflush (stdout);
+  do
+    n = read (fileno (r->fid), r->in, READ_BLOCK);
+  while (n < 0 && errno == EINTR);
+  if (n <= 0)
+    return 0;
+  r->inp = r->in;
+  r->inend = r->in + n;
+  return 1;
+}
+
 /* Read next character in the stream. */
 static int reader_getc (reader_t * r)
 {
-  int c;
   if (r->readbufp > r->readbuf)
-    {
-      c = *(r->readbufp);
-      r->readbufp--;
-      return c;
-    }
-  if (r->str != NULL)
-    {
-      c = *(r->strp);
-      if (c != '\0')
-	r->strp++;
-      else
-	return EOF;
-    }
-  else
-    c = fgetc (r->fid);
-  return c;
+    return *(r->readbufp--);
+  if (r->inp == r->inend && !reader_fill (r))
+    return EOF;
+  return (unsigned char) *(r->inp++);
 }
 
 /* Unread a byte. */
@@ -106,6 +150,19 @@ static void consume_whitespace (reader_t * r)
 /* Consume remaining characters on line, including linefeed. */
 static void consume_line (reader_t * r)
 {
+  if (r->readbufp == r->readbuf)
+    {
+      char *nl;
+      while ((nl = memchr (r->inp, '\n', r->inend - r->inp)) == NULL)
+	if (!reader_fill (r))
+	  {
+	    r->inp = r->inend;
+	    reader_putc (r, EOF);
+	    return;
+	  }
+      r->inp = nl + 1;
+      return;
+    }
   int c = reader_getc (r);
   while (c != '\n' && c != EOF)
     c = reader_getc (r);
@@ -235,51 +292,97 @@ static void addpop (reader_t * r)
     add (r, o);
 }
 
-/* Append character to buffer. */
-static void buf_append (reader_t * r, char c)
+/* Append bytes to buffer. */
+static void buf_append_n (reader_t * r, char *s, size_t n)
 {
-  if (r->bufp == r->buf + r->buflen)
+  size_t len = r->bufp - r->buf;
+  if (len + n > r->buflen)
     {
-      r->buflen *= 2;
+      while (len + n > r->buflen)
+	r->buflen *= 2;
       r->buf = xrealloc (r->buf, r->buflen + 1);
-      r->bufp = r->buf + r->buflen / 2;
+      r->bufp = r->buf + len;
     }
-  *(r->bufp) = c;
-  *(r->bufp + 1) = '\0';
-  r->bufp++;
+  memcpy (r->bufp, s, n);
+  r->bufp += n;
+  *(r->bufp) = '\0';
 }
 
-/* Load into buffer until character, ignoring escaped ones. */
-static int buf_read (reader_t * r, char *halt)
+/* Append character to buffer. */
+static void buf_append (reader_t * r, char c)
 {
-  int esc = 0;
-  int c = reader_getc (r);
-  esc = 0;
-  if (c == '\\')
+  buf_append_n (r, &c, 1);
+}
+
+/* Load the rest of an atom into the buffer, up to a delimiter. A
+ * backslash escapes the character after it. */
+static void read_atom (reader_t * r)
+{
+  int c;
+  while (1)
     {
+      /* Copy runs of plain characters straight from the block. */
+      if (r->readbufp == r->readbuf)
+	{
+	  char *p = r->inp;
+	  while (p < r->inend
+		 && !(char_class[(unsigned char) *p] & (CC_DELIM | CC_ESCAPE)))
+	    p++;
+	  buf_append_n (r, r->inp, p - r->inp);
+	  r->inp = p;
+	}
       c = reader_getc (r);
-      esc = 1;
+      if (c == '\\')
+	c = reader_getc (r);
+      else if (c != EOF && char_class[c] & CC_DELIM)
+	break;
+      if (c == EOF)
+	break;
+      buf_append (r, c);
     }
-  while ((esc || strchr (halt, c) == NULL) && (c != EOF))
+  reader_putc (r, c);
+}
+
+/* Load a string into the buffer, up to and including the closing
+ * quote, which is thrown away. A backslash escapes the character after
+ * it. */
+static void read_string (reader_t * r)
+{
+  int c;
+  while (1)
     {
-      buf_append (r, c);
+      if (r->readbufp == r->readbuf)
+	{
+	  size_t n = r->inend - r->inp;
+	  char *end = memchr (r->inp, '"', n);
+	  if (end != NULL)
+	    n = end - r->inp;
+	  end = memchr (r->inp, '\\', n);
+	  if (end != NULL)
+	    n = end - r->inp;
+	  buf_append_n (r, r->inp, n);
+	  r->inp += n;
+	}
       c = reader_getc (r);
-      esc = 0;
       if (c == '\\')
+	c = reader_getc (r);
+      else if (c == '"')
+	break;
+      if (c == EOF)
 	{
-	  c = reader_getc (r);
-	  esc = 1;
+	  reader_putc (r, c);
+	  break;
 	}
+      buf_append (r, c);
     }
-  reader_putc (r, c);
-  return !esc;
 }
 
 /* Turn string in buffer into string object. */
 static object_t *parse_str (reader_t * r)
 {
   size_t size = r->bufp - r->buf;
-  char *str = xstrdup (r->buf);
+  char *str = xmalloc (size + 1);
+  memcpy (str, r->buf, size + 1);
   reset_buf (r);
   return c_str (str, size);
 }
@@ -287,34 +390,18 @@ static object_t *parse_str (reader_t * r)
 /* Turn string in buffer into atom object. */
 static object_t *parse_atom (reader_t * r)
 {
-  char *str = r->buf;
-  char *end;
-
-  /* Detect integer */
-  int i = strtol (str, &end, 10);
-  (void) i;
-  if (end != str && *end == '\0')
+  object_t *o = c_number (r->buf);
+  if (o != NULL)
     {
-      object_t *o = c_ints (str);
-      reset_buf (r);
-      return o;
-    }
-
-  /* Detect float */
-  int d = strtod (str, &end);
-  (void) d;
-  if (end != str && *end == '\0')
-    {
-      object_t *o = c_floats (str);
       reset_buf (r);
       return o;
     }
 
   /* Might be a symbol then */
   char *p = r->buf;
-  while (p <= r->bufp)
+  while (p < r->bufp)
     {
-      if (strchr (atom_chars, *p) == NULL)
+      if (!(char_class[(unsigned char) *p] & CC_ATOM))
 	{
 	  char *errstr = xstrdup ("invalid symbol character: X");
 	  errstr[strlen (errstr) - 1] = *p;
@@ -324,7 +411,7 @@ static object_t *parse_atom (reader_t * r)
 	}
       p++;
     }
-  object_t *o = c_sym (r->buf);
+  o = c_sym (r->buf);
   reset_buf (r);
   return o;
 }
@@ -440,15 +527,14 @@ object_t *read_sexp (reader_t * r)
 
 	  /* strings */
 	case '"':
-	  buf_read (r, "\"");
+	  read_string (r);
 	  add (r, parse_str (r));
-	  reader_getc (r);	/* Throw away other quote. */
 	  break;
 
 	  /* numbers and symbols */
 	default:
 	  buf_append (r, c);
-	  buf_read (r, " \t\r\n()[];");
+	  read_atom (r);
 	  object_t *o = parse_atom (r);
 	  if (!r->error)
 	    add (r, o);
@@ -480,16 +566,106 @@ object_t *read_sexp (reader_t * r)
   return sexp;
 }
 
+object_t *read_line (reader_t * r)
+{
+  int c = 0, any = 0;
+  while (r->readbufp > r->readbuf)
+    {
+      c = reader_getc (r);
+      if (c == '\n' || c == EOF)
+	break;
+      buf_append (r, c);
+      any = 1;
+    }
+  while (c != '\n' && c != EOF)
+    {
+      if (r->inp == r->inend && !reader_fill (r))
+	{
+	  c = EOF;
+	  break;
+	}
+      char *nl = memchr (r->inp, '\n', r->inend - r->inp);
+      char *end = nl ? nl : r->inend;
+      buf_append_n (r, r->inp, end - r->inp);
+      r->inp = nl ? nl + 1 : end;
+      if (nl != NULL)
+	c = '\n';
+      any = 1;
+    }
+  if (c == '\n')
+    r->linecnt++;
+  else if (!any)
+    {
+      reader_putc (r, EOF);
+      return NULL;
+    }
+  return parse_str (r);
+}
+
+size_t read_bytes (reader_t * r, char *dst, size_t n)
+{
+  size_t got = 0;
+  while (got < n && r->readbufp > r->readbuf)
+    {
+      int c = reader_getc (r);
+      if (c == EOF)
+	{
+	  reader_putc (r, c);
+	  return got;
+	}
+      dst[got++] = c;
+    }
+  while (got < n)
+    {
+      size_t len = r->inend - r->inp;
+      if (len == 0)
+	{
+	  /* Big requests skip the block buffer. */
+	  if (r->in != NULL && n - got >= READ_BLOCK)
+	    {
+	      ssize_t k;
+	      do
+		k = read (fileno (r->fid), dst + got, n - got);
+	      while (k < 0 && errno == EINTR);
+	      if (k <= 0)
+		break;
+	      got += k;
+	      continue;
+	    }
+	  if (!reader_fill (r))
+	    break;
+	  len = r->inend - r->inp;
+	}
+      if (len > n - got)
+	len = n - got;
+      memcpy (dst + got, r->inp, len);
+      r->inp += len;
+      got += len;
+    }
+  return got;
+}
+
 /* Use the core functions above to eval each sexp in a file. */
 int load_file (FILE * fid, char *filename, int interactive)
 {
   if (fid == NULL)
     {
+      /* Use the fasl file instead while it's up to date. */
+      char *fasl = fasl_name (filename);
+      if (fasl != NULL && fasl_fresh (filename, fasl))
+	{
+	  int r = load_fasl (fasl);
+	  xfree (fasl);
+	  return r;
+	}
+      xfree (fasl);
       fid = fopen (filename, "r");
       if (fid == NULL)
 	return 0;
     }
   reader_t *r = reader_create (fid, NULL, filename, interactive);
+  /* Each file starts out dynamically scoped. */
+  sympush (lexical_binding, NIL);
   while (!r->eof)
     {
       object_t *sexp = read_sexp (r);
@@ -502,6 +678,7 @@ int load_file (FILE * fid, char *filename, int interactive)
 	  obj_destroy (ret);
 	}
     }
+  sympop (lexical_binding);
   reader_destroy (r);
   return 1;
 }
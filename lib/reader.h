@@ -28,7 +28,9 @@ typedef struct reader
 
   /** reader state **/
   unsigned int linecnt;
-  char *strp;
+
+  /* input block, the whole string when reading from one */
+  char *in, *inp, *inend;
 
   /* atom read buffer */
   char *buf, *bufp;
@@ -55,6 +57,14 @@ void reader_destroy (reader_t * r);
 /* Read a single sexp from the reader. */
 object_t *read_sexp (reader_t * r);
 
+/* Read the rest of the current line as a string, without its newline,
+ * or return NULL at the end of input. */
+object_t *read_line (reader_t * r);
+
+/* Copy up to n bytes of input into dst, returning how many there were
+ * before the end of input. */
+size_t read_bytes (reader_t * r, char *dst, size_t n);
+
 /* Use the core functions above to eval each sexp in a file. */
 int load_file (FILE * fid, char *filename, int interactive);
 
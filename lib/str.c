@@ -11,35 +11,27 @@ static void str_clear (void *s)
 {
   str_t *str = (str_t *) s;
   str->raw = NULL;
-  str->print = NULL;
   str->len = 0;
 }
 
 void str_init ()
 {
-  mm = mm_create (sizeof (str_t), &str_clear);
+  mm = mm_create ("string", sizeof (str_t), &str_clear);
 }
 
 str_t *str_create ()
 {
-  return (str_t *) mm_alloc (mm);
+  str_t *str = (str_t *) mm_alloc (mm);
+  str->hash = 0;		/* shares the free list link */
+  return str;
 }
 
 void str_destroy (str_t * str)
 {
   xfree (str->raw);
-  if (str->print != NULL)
-    xfree (str->print);
   mm_free (mm, (void *) str);
 }
 
-void str_genp (object_t * o)
-{
-  str_t *str = (str_t *) OVAL (o);
-  if (str->print == NULL)
-    str->print = unprocess_str (str->raw);
-}
-
 object_t *str_cat (object_t * ao, object_t * bo)
 {
   str_t *a = (str_t *) OVAL (ao);
@@ -65,7 +57,11 @@ object_t *c_strs (char *str)
   return c_str (str, strlen (str));
 }
 
+/* Strings are never modified, so the hash is kept. */
 uint32_t str_hash (object_t * o)
 {
-  return hash (OSTR (o), OSTRLEN (o));
+  str_t *str = (str_t *) OVAL (o);
+  if (str->hash == 0)
+    str->hash = hash (str->raw, str->len);
+  return str->hash;
 }
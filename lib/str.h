@@ -6,8 +6,8 @@
 typedef struct str
 {
   char *raw;
-  char *print;
   size_t len;
+  uint32_t hash;		/* 0 until computed */
 } str_t;
 
 /* Must be called before any other functions. */
@@ -19,14 +19,11 @@ void str_destroy ();
 object_t *c_str (char *str, size_t len);
 object_t *c_strs (char *str);
 
-void str_genp (object_t * o);
-
 /* String operators */
 object_t *str_cat (object_t * ao, object_t * bo);
 
 #define OSTR(o) (((str_t *) OVAL(o))->raw)
 #define OSTRLEN(o) (((str_t *) OVAL(o))->len)
-#define OSTRP(o) (str_genp (o), ((str_t *) OVAL(o))->print)
 
 uint32_t str_hash (object_t * o);
 
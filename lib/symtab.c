@@ -9,6 +9,10 @@ static hashtab_t *symbol_table;
 
 object_t *NIL, *T;
 
+#define SYM(var, name) object_t *var;
+#include "symbols.def"
+#undef SYM
+
 void symtab_init ()
 {
   symbol_table = ht_init (2048, NULL);
@@ -20,12 +24,17 @@ void symtab_init ()
   T = c_sym ("t");
   SYMPROPS (T) |= SYM_CONSTANT;
   SET (T, T);
+
+#define SYM(var, name) var = c_sym (name);
+#include "symbols.def"
+#undef SYM
 }
 
 symbol_t *symbol_create ()
 {
   symbol_t *s = xmalloc (sizeof (symbol_t));
   s->props = 0;
+  s->hash = 0;
   s->cnt = 8;
   s->vals = s->stack = xmalloc (sizeof (object_t *) * s->cnt);
   return s;
@@ -59,6 +68,7 @@ object_t *c_usym (char *name)
   char *newname = xstrdup (name);
   o = obj_create (SYMBOL);
   SYMNAME (o) = newname;
+  ((symbol_t *) OVAL (o))->hash = hash (newname, strlen (newname));
   *((symbol_t *) OVAL (o))->vals = NIL;
   if (name[0] == ':')
     SET (o, o);
@@ -83,7 +93,14 @@ object_t *c_sym (char *name)
   return o;
 }
 
+void symtab_map (void (*f) (object_t * sym, void *arg), void *arg)
+{
+  hashtab_iter_t ii;
+  for (ht_iter_init (symbol_table, &ii); ii.key != NULL; ht_iter_inc (&ii))
+    f ((object_t *) ii.value, arg);
+}
+
 uint32_t symbol_hash (object_t * o)
 {
-  return hash (SYMNAME (o), strlen (SYMNAME (o)));
+  return ((symbol_t *) OVAL (o))->hash;
 }
@@ -11,6 +11,7 @@ typedef struct symbol
   object_t **vals;
   object_t **stack;
   unsigned int cnt;
+  uint32_t hash;		/* hash of the name */
 } symbol_t;
 
 /* Must be called before any other symbtab functions are called. */
@@ -22,6 +23,9 @@ object_t *c_sym (char *name);	/* Interned symbol. */
 object_t *c_usym (char *name);	/* Uinterned symbol. */
 void intern (object_t * sym);
 
+/* Call f on each interned symbol. f must not create symbols. */
+void symtab_map (void (*f) (object_t * sym, void *arg), void *arg);
+
 /* Dynamic scoping */
 void sympop (object_t * so);
 void sympush (object_t * so, object_t * o);
@@ -37,6 +41,11 @@ void sympush (object_t * so, object_t * o);
 extern object_t *NIL;
 extern object_t *T;
 
+/* Predefined symbols */
+#define SYM(var, name) extern object_t *var;
+#include "symbols.def"
+#undef SYM
+
 /* symbol properties */
 #define SYM_CONSTANT 1
 #define SYM_INTERNED 2
@@ -4,43 +4,23 @@
 #include "symtab.h"
 #include "cons.h"
 #include "number.h"
-#include "mem.h"
 #include "eval.h"
 
-static mmanager_t *mm;
-static object_t *out_of_bounds;
-
-static void vector_clear (void *o)
-{
-  vector_t *v = (vector_t *) o;
-  v->v = NULL;
-  v->len = 0;
-}
-
-void vector_init ()
-{
-  mm = mm_create (sizeof (vector_t), &vector_clear);
-  out_of_bounds = c_sym ("index-out-of-bounds");
-}
-
-vector_t *vector_create ()
-{
-  return (vector_t *) mm_alloc (mm);
-}
-
-void vector_destroy (vector_t * v)
+void vector_destroy (object_t * o)
 {
+  vector_t *v = OVEC (o);
   size_t i;
   for (i = 0; i < v->len; i++)
     obj_destroy (v->v[i]);
   xfree (v->v);
-  mm_free (mm, (void *) v);
+  v->v = NULL;
+  v->len = 0;
 }
 
 object_t *c_vec (size_t len, object_t * init)
 {
   object_t *o = obj_create (VECTOR);
-  vector_t *v = OVAL (o);
+  vector_t *v = OVEC (o);
   v->len = len;
   if (len == 0)
     len = 1;
@@ -74,7 +54,7 @@ object_t *list2vector (object_t * lst)
 
 void vset (object_t * vo, size_t i, object_t * val)
 {
-  vector_t *v = OVAL (vo);
+  vector_t *v = OVEC (vo);
   object_t *o = v->v[i];
   v->v[i] = val;
   obj_destroy (o);
@@ -83,7 +63,7 @@ void vset (object_t * vo, size_t i, object_t * val)
 object_t *vset_check (object_t * vo, object_t * io, object_t * val)
 {
   int i = into2int (io);
-  vector_t *v = OVAL (vo);
+  vector_t *v = OVEC (vo);
   if (i < 0 || i >= (int) v->len)
     THROW (out_of_bounds, UPREF (io));
   vset (vo, i, UPREF (val));
@@ -92,36 +72,36 @@ object_t *vset_check (object_t * vo, object_t * io, object_t * val)
 
 object_t *vget (object_t * vo, size_t i)
 {
-  vector_t *v = OVAL (vo);
+  vector_t *v = OVEC (vo);
   return v->v[i];
 }
 
 object_t *vget_check (object_t * vo, object_t * io)
 {
   int i = into2int (io);
-  vector_t *v = OVAL (vo);
+  vector_t *v = OVEC (vo);
   if (i < 0 || i >= (int) v->len)
     THROW (out_of_bounds, UPREF (io));
   return UPREF (vget (vo, i));
 }
 
-void vec_print (object_t * vo)
+void vec_print (printer_t * p, object_t * vo)
 {
-  vector_t *v = OVAL (vo);
+  vector_t *v = OVEC (vo);
   if (v->len == 0)
     {
-      printf ("[]");
+      printer_puts (p, "[]");
       return;
     }
-  printf ("[");
+  printer_putc (p, '[');
   size_t i;
   for (i = 0; i < v->len - 1; i++)
     {
-      obj_print (v->v[i], 0);
-      printf (" ");
+      obj_write (p, v->v[i]);
+      printer_putc (p, ' ');
     }
-  obj_print (v->v[v->len - 1], 0);
-  printf ("]");
+  obj_write (p, v->v[v->len - 1]);
+  printer_putc (p, ']');
 }
 
 object_t *vector_concat (object_t * a, object_t * b)
@@ -138,7 +118,7 @@ object_t *vector_concat (object_t * a, object_t * b)
 
 object_t *vector_sub (object_t * vo, int start, int end)
 {
-  vector_t *v = OVAL (vo);
+  vector_t *v = OVEC (vo);
   if (end == -1)
     end = v->len - 1;
   object_t *newv = c_vec (1 + end - start, NIL);
@@ -148,12 +128,14 @@ object_t *vector_sub (object_t * vo, int start, int end)
   return newv;
 }
 
-uint32_t vector_hash (object_t * o)
+uint32_t vector_hash (object_t * o, int depth)
 {
-  uint32_t accum = 0;
-  vector_t *v = OVAL (o);
+  vector_t *v = OVEC (o);
+  uint32_t h = word_hash (v->len);
   size_t i;
-  for (i = 0; i < v->len; i++)
-    accum ^= obj_hash (v->v[i]);
-  return accum;
+  if (depth >= HASH_DEPTH)
+    return h;
+  for (i = 0; i < v->len && i < HASH_LENGTH; i++)
+    h = hash_combine (h, obj_hash_depth (v->v[i], depth + 1));
+  return h;
 }
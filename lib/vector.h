@@ -3,17 +3,12 @@
 
 #include <stdio.h>
 #include "object.h"
+#include "printer.h"
 
-typedef struct vector
-{
-  object_t **v;
-  size_t len;
-} vector_t;
+typedef struct vector vector_t;
 
 /* standard object functions */
-void vector_init ();
-vector_t *vector_create ();
-void vector_destroy (vector_t * o);
+void vector_destroy (object_t * o);
 
 /* General vector creation. */
 object_t *c_vec (size_t len, object_t * init);
@@ -34,12 +29,13 @@ object_t *vector_concat (object_t * a, object_t * b);
 object_t *vector_sub (object_t * vo, int start, int end);
 
 /* Print a vector */
-void vec_print (object_t * vo);
+void vec_print (printer_t * p, object_t * vo);
 
 #define VECTORP(o) ((o)->type == VECTOR)
 
-#define VLENGTH(o) (((vector_t *) OVAL(o))->len)
+#define OVEC(o) (&(o)->uval.vec)
+#define VLENGTH(o) ((o)->uval.vec.len)
 
-uint32_t vector_hash (object_t * o);
+uint32_t vector_hash (object_t * o, int depth);
 
 #endif /* VECTOR_H */
@@ -0,0 +1,697 @@
+/* vm.c - run compiled lambda bodies */
+#include <string.h>
+#include "common.h"
+#include "object.h"
+#include "cons.h"
+#include "symtab.h"
+#include "eval.h"
+#include "str.h"
+#include "number.h"
+#include "cycle.h"
+#include "vector.h"
+#include "vm.h"
+
+/* Checks the tree walker makes on every eval, made by the VM on calls
+ * and backward jumps. */
+#define VM_POLL()						\
+  if (interrupt)						\
+    {								\
+      interrupt = 0;						\
+      err_thrown = err_interrupt;				\
+      err_attach = c_strs (xstrdup ("interrupted"));		\
+      goto error;						\
+    }								\
+  DESTROY_CHECK ();						\
+  CYCLE_CHECK ();
+
+/* obj_destroy(), with the common cases handled here. */
+static void release (object_t * o)
+{
+  if (SYMBOLP (o))
+    return;
+  if (o->refs > 1 && !CONTAINERP (o))
+    o->refs--;
+  else
+    obj_destroy (o);
+}
+
+/* Build a list from an array, taking over the references. */
+static object_t *list_of (object_t ** v, int n)
+{
+  object_t *lst = NIL;
+  while (n > 0)
+    lst = c_cons (v[--n], lst);
+  return lst;
+}
+
+static object_t *args_list (object_t ** v, int n)
+{
+  int i;
+  for (i = 0; i < n; i++)
+    (void) UPREF (v[i]);
+  return list_of (v, n);
+}
+
+/* Return a fixnum, reusing a temporary no one else holds if there is
+ * one. */
+static object_t *fixnum (long n, object_t * tmp)
+{
+  if (tmp == NULL)
+    return c_int (n);
+  OFIX (tmp) = n;
+  return UPREF (tmp);
+}
+
+/* Common cases of builtins, or NULL to call the builtin itself. */
+static object_t *prim_fast (prim_t p, object_t ** v, int n, object_t * tmp)
+{
+  if (n == 2 && FIXP (v[0]) && FIXP (v[1]))
+    {
+      long a = OFIX (v[0]), b = OFIX (v[1]), r;
+      switch (p)
+	{
+	case PRIM_ADD:
+	  if (__builtin_add_overflow (a, b, &r))
+	    return NULL;
+	  return fixnum (r, tmp);
+	case PRIM_SUB:
+	  if (__builtin_sub_overflow (a, b, &r))
+	    return NULL;
+	  return fixnum (r, tmp);
+	case PRIM_MUL:
+	  if (__builtin_mul_overflow (a, b, &r))
+	    return NULL;
+	  return fixnum (r, tmp);
+	case PRIM_NUM_EQ:
+	  return a == b ? T : NIL;
+	case PRIM_LT:
+	  return a < b ? T : NIL;
+	case PRIM_LTE:
+	  return a <= b ? T : NIL;
+	case PRIM_GT:
+	  return a > b ? T : NIL;
+	case PRIM_GTE:
+	  return a >= b ? T : NIL;
+	default:
+	  break;
+	}
+    }
+  if (n == 1)
+    switch (p)
+      {
+      case PRIM_CAR:
+	if (CONSP (v[0]))
+	  return UPREF (CAR (v[0]));
+	break;
+      case PRIM_CDR:
+	if (CONSP (v[0]))
+	  return UPREF (CDR (v[0]));
+	break;
+      case PRIM_NOT:
+      case PRIM_NULLP:
+	return v[0] == NIL ? T : NIL;
+      default:
+	break;
+      }
+  if (n == 2)
+    switch (p)
+      {
+      case PRIM_CONS:
+	return c_cons (UPREF (v[0]), UPREF (v[1]));
+      case PRIM_EQ:
+	return v[0] == v[1] ? T : NIL;
+      default:
+	break;
+      }
+  return NULL;
+}
+
+static int arity_ok (code_t * c, int argc)
+{
+  return argc >= c->nreq && (c->rest || argc <= c->nreq + c->nopt);
+}
+
+/* Compiled code of a lambda function or closure, or NULL. */
+static code_t *func_code (object_t * f)
+{
+  if (CLOSUREP (f) || (CONSP (f) && CAR (f) == lambda))
+    return code_get (f);
+  return NULL;
+}
+
+static object_t *func_env (object_t * f)
+{
+  return CLOSUREP (f) ? CLOSURE_ENV (f) : NIL;
+}
+
+/* Number of parameters code binds dynamically. */
+static int nbound (code_t * c)
+{
+  return c->lexical ? 0 : c->nreq + c->nopt + c->rest;
+}
+
+/* A new frame of n slots inside env, taking the reference to env. */
+static object_t *frame_enter (int n, object_t * env)
+{
+  object_t *frame = c_vec (n + 1, NIL);
+  OVEC (frame)->v[0] = env;
+  return frame;
+}
+
+/* The frame depth frames out from env. */
+static object_t *frame_out (object_t * env, int depth)
+{
+  while (depth-- > 0)
+    env = OVEC (env)->v[0];
+  return env;
+}
+
+/* Where a variable described by OP_EVAL operands lives. */
+static object_t **lex_ref (object_t ** locals, object_t * env, int *lex)
+{
+  if (lex[1] == LEX_LOCAL)
+    return &locals[lex[2]];
+  return &OVEC (frame_out (env, lex[1]))->v[lex[2]];
+}
+
+/* Store a value in a variable, releasing the old one. */
+static void lex_store (object_t ** p, object_t * val)
+{
+  object_t *old = *p;
+  *p = UPREF (val);
+  release (old);
+}
+
+/* Place the arguments of lexical code in its locals, and its frame if
+ * some are captured. Returns the environment the body runs in, with a
+ * reference the caller owns. */
+static object_t *lex_params (code_t * c, object_t ** locals,
+			     object_t ** argv, int argc, object_t * env)
+{
+  int nparams = c->nreq + c->nopt, i;
+  for (i = 0; i < c->nlocals; i++)
+    locals[i] = NIL;
+  (void) UPREF (env);
+  if (c->framesize > 0)
+    env = frame_enter (c->framesize, env);
+  for (i = 0; i < nparams + c->rest; i++)
+    {
+      object_t *val;
+      if (i < nparams)
+	val = i < argc ? UPREF (argv[i]) : NIL;
+      else
+	val = argc > nparams ?
+	  args_list (argv + nparams, argc - nparams) : NIL;
+      if (c->slots[i] >= 0)
+	locals[c->slots[i]] = val;
+      else
+	OVEC (env)->v[-c->slots[i]] = val;
+    }
+  return env;
+}
+
+static void lex_release (code_t * c, object_t ** locals, object_t * env)
+{
+  int i;
+  for (i = 0; i < c->nlocals; i++)
+    release (locals[i]);
+  release (env);
+}
+
+/* A growable array that may start out in storage on the C stack. */
+typedef struct frame
+{
+  object_t **v;
+  int n, size;
+  object_t **local;
+} frame_t;
+
+static void frame_reserve (frame_t * f, int size)
+{
+  if (size <= f->size)
+    return;
+  object_t **v = xmalloc (size * sizeof (object_t *));
+  memcpy (v, f->v, f->n * sizeof (object_t *));
+  if (f->v != f->local)
+    xfree (f->v);
+  f->v = v;
+  f->size = size;
+}
+
+static void frame_free (frame_t * f)
+{
+  if (f->v != f->local)
+    xfree (f->v);
+}
+
+/* Append to the array, doubling its storage when it is full. */
+static void frame_push (frame_t * f, object_t * o)
+{
+  if (f->n == f->size)
+    frame_reserve (f, f->size * 2 + 4);
+  f->v[f->n++] = o;
+}
+
+/* Bind a symbol for the rest of the frame. Once a frame has bound a
+ * symbol, no one can see the old value again, so a tail call binding
+ * it again replaces the value instead of growing the symbol's stack. */
+static void frame_bind (frame_t * f, object_t * sym, object_t * val)
+{
+  int i;
+  for (i = 0; i < f->n; i++)
+    if (f->v[i] == sym)
+      {
+	SET (sym, val);
+	return;
+      }
+  frame_push (f, sym);
+  sympush (sym, val);
+}
+
+/* Keep a symbol bound by a let for the rest of the frame. If the frame
+ * already holds a binding of it, the new value replaces that one. */
+static void frame_keep (frame_t * f, object_t * sym)
+{
+  int i;
+  for (i = 0; i < f->n; i++)
+    if (f->v[i] == sym)
+      {
+	object_t *val = UPREF (GET (sym));
+	sympop (sym);
+	SSET (sym, val);
+	return;
+      }
+  frame_push (f, sym);
+}
+
+/* A catch in progress, and where to go when its tag is thrown. */
+typedef struct handler
+{
+  object_t *tag, *env;
+  int sp, nbinds;
+  size_t target;
+} handler_t;
+
+/* Bind parameters, through the frame if there is one. */
+static void bind_params (frame_t * f, code_t * c, object_t ** argv,
+			 int argc)
+{
+  int nparams = c->nreq + c->nopt, i;
+  for (i = 0; i < nparams; i++)
+    {
+      object_t *val = i < argc ? argv[i] : NIL;
+      if (f == NULL)
+	sympush (c->params[i], val);
+      else
+	frame_bind (f, c->params[i], val);
+    }
+  if (c->rest)
+    {
+      object_t *r = argc > nparams ?
+	args_list (argv + nparams, argc - nparams) : NIL;
+      if (f == NULL)
+	sympush (c->params[nparams], r);
+      else
+	frame_bind (f, c->params[nparams], r);
+      release (r);
+    }
+}
+
+object_t *vm_exec (code_t * c, object_t ** argv, int argc, object_t * env)
+{
+  int i;
+  if (!arity_ok (c, argc))
+    THROW (wrong_number_of_arguments, args_list (argv, argc));
+
+  object_t *stack_space[c->maxstack + 1], *binds_space[c->maxbinds + 1];
+  object_t *local_space[c->nlocals + 1];
+  frame_t stk = { stack_space, 0, c->maxstack + 1, stack_space };
+  frame_t bnd = { binds_space, 0, c->maxbinds + 1, binds_space };
+  frame_t loc = { local_space, 0, c->nlocals + 1, local_space };
+  object_t **stack = stk.v, **binds = bnd.v, **locals = loc.v;
+  if (c->lexical)
+    env = lex_params (c, locals, argv, argc, env);
+  else
+    {
+      bind_params (NULL, c, argv, argc);
+      env = NIL;
+    }
+
+  /* Everything bound by this frame once it has made a tail call */
+  frame_t bound = { NULL, 0, 0, NULL };
+  code_t *entry = c;
+
+  handler_t *handlers = NULL;
+  int nhandlers = 0, handlers_size = 0;
+  object_t **consts = c->consts;
+  object_t *self = NULL;	/* function of the last tail call */
+  int *ops = c->ops;
+  int sp = 0, nbinds = 0;
+  size_t pc = 0;
+  object_t *r;
+  for (;;)
+    {
+    dispatch:
+      switch (ops[pc])
+	{
+	case OP_CONST:
+	  stack[sp++] = UPREF (consts[ops[pc + 1]]);
+	  pc += 2;
+	  break;
+	case OP_VAR:
+	  stack[sp++] = UPREF (GET (consts[ops[pc + 1]]));
+	  pc += 2;
+	  break;
+	case OP_SET:
+	  SET (consts[ops[pc + 1]], stack[sp - 1]);
+	  pc += 2;
+	  break;
+	case OP_POP:
+	  release (stack[--sp]);
+	  pc++;
+	  break;
+	case OP_JUMP:
+	  if ((size_t) ops[pc + 1] < pc)
+	    {
+	      VM_POLL ();
+	    }
+	  pc = ops[pc + 1];
+	  break;
+	case OP_JNIL:
+	  r = stack[--sp];
+	  if (r == NIL)
+	    pc = ops[pc + 1];
+	  else
+	    {
+	      release (r);
+	      pc += 2;
+	    }
+	  break;
+	case OP_JNIL_KEEP:
+	  if (stack[sp - 1] == NIL)
+	    pc = ops[pc + 1];
+	  else
+	    {
+	      release (stack[--sp]);
+	      pc += 2;
+	    }
+	  break;
+	case OP_JTRUE_KEEP:
+	  if (stack[sp - 1] != NIL)
+	    pc = ops[pc + 1];
+	  else
+	    {
+	      sp--;
+	      pc += 2;
+	    }
+	  break;
+	case OP_GUARD:
+	  if (GET (consts[ops[pc + 1]]) != consts[ops[pc + 2]])
+	    pc = ops[pc + 3];
+	  else
+	    pc += 4;
+	  break;
+	case OP_EVAL:
+	  {
+	    int n = ops[pc + 2], *lex = ops + pc + 3;
+	    for (i = n - 1; i >= 0; i--)
+	      sympush (consts[lex[i * 3]],
+		       *lex_ref (locals, env, lex + i * 3));
+	    r = eval (consts[ops[pc + 1]]);
+	    for (i = 0; i < n; i++)
+	      {
+		object_t *sym = consts[lex[i * 3]];
+		lex_store (lex_ref (locals, env, lex + i * 3), GET (sym));
+		sympop (sym);
+	      }
+	    if (r == err_symbol)
+	      goto error;
+	    stack[sp++] = r;
+	    pc += 3 + n * 3;
+	  }
+	  break;
+	case OP_FUNC:
+	  r = GET (consts[ops[pc + 1]]);
+	  if (r->type == CFUNC || CLOSUREP (r)
+	      || (r->type == CONS && CAR (r) == lambda))
+	    {
+	      stack[sp++] = UPREF (r);
+	      pc += 3;
+	    }
+	  else
+	    pc = ops[pc + 2];
+	  break;
+	case OP_TAILCALL:
+	case OP_CALL:
+	  {
+	    VM_POLL ();
+	    int n = ops[pc + 1];
+	    object_t **args = stack + sp - n, *f = args[-1];
+	    code_t *callee;
+	    if (ops[pc] == OP_TAILCALL && (callee = func_code (f)) != NULL
+		&& arity_ok (callee, n))
+	      {
+		/* Bindings made so far, including by an enclosing let,
+		 * stay until the frame exits, once per symbol. */
+		if (bound.v == NULL)
+		  {
+		    int np = nbound (entry);
+		    frame_reserve (&bound, np + nbinds + 4);
+		    memcpy (bound.v, entry->params, np * sizeof (object_t *));
+		    bound.n = np;
+		  }
+		for (i = 0; i < nbinds; i++)
+		  frame_keep (&bound, binds[i]);
+		nbinds = 0;
+		lex_release (c, locals, env);
+		frame_reserve (&loc, callee->nlocals + 1);
+		locals = loc.v;
+		if (callee->lexical)
+		  env = lex_params (callee, locals, args, n, func_env (f));
+		else
+		  {
+		    bind_params (&bound, callee, args, n);
+		    env = NIL;
+		  }
+		for (i = 0; i < n; i++)
+		  release (args[i]);
+		sp -= n + 1;
+		while (sp > 0)
+		  release (stack[--sp]);
+
+		/* Run the callee in this frame, keeping it alive. */
+		c = callee;
+		frame_reserve (&stk, c->maxstack + 1);
+		frame_reserve (&bnd, c->maxbinds + 1);
+		stack = stk.v;
+		binds = bnd.v;
+		consts = c->consts;
+		ops = c->ops;
+		pc = 0;
+		if (self != NULL)
+		  release (self);
+		self = f;
+		break;
+	      }
+	    if (++stack_depth >= max_stack_depth)
+	      {
+		err_thrown = sym_max_eval_depth;
+		err_attach = c_int (stack_depth--);
+		goto error;
+	      }
+	    if ((callee = func_code (f)) != NULL)
+	      {
+		r = vm_exec (callee, args, n, func_env (f));
+		for (i = 0; i < n; i++)
+		  release (args[i]);
+	      }
+	    else if (f->type == CFUNC)
+	      {
+		r = cfunc_call (f, n, args);
+		for (i = 0; i < n; i++)
+		  release (args[i]);
+	      }
+	    else if (!FUNCP (f))
+	      {
+		/* Only lexical code calls a value that may not be one. */
+		err_thrown = void_function;
+		err_attach = UPREF (f);
+		stack_depth--;
+		goto error;
+	      }
+	    else
+	      {
+		object_t *lst = list_of (args, n);
+		r = apply (f, lst);
+		release (lst);
+	      }
+	    stack_depth--;
+	    release (f);
+	    sp -= n + 1;
+	    if (r == err_symbol)
+	      goto error;
+	    stack[sp++] = r;
+	    pc += 2;
+	  }
+	  break;
+	case OP_PRIM:
+	  {
+	    int n = ops[pc + 1], *src = ops + pc + 6, base = sp, j;
+	    if (ops[pc + 4] >= 0
+		&& GET (consts[ops[pc + 4]]) != consts[ops[pc + 2]])
+	      {
+		pc = ops[pc + 5];
+		break;
+	      }
+	    object_t *v[PRIM_MAX], *tmp = NULL;
+	    for (i = 0; i < n; i++)
+	      if (src[i] == PRIM_STACK)
+		base--;
+	    for (i = 0, j = base; i < n; i++)
+	      if (src[i] == PRIM_STACK)
+		{
+		  v[i] = stack[j++];
+		  if (v[i]->refs == 1 && FIXP (v[i]))
+		    tmp = v[i];
+		}
+	      else if (src[i] < 0)
+		v[i] = locals[PRIM_LOCAL (src[i])];
+	      else if (src[i] & 1)
+		v[i] = GET (consts[src[i] >> 1]);
+	      else
+		v[i] = consts[src[i] >> 1];
+	    r = prim_fast (ops[pc + 3], v, n, tmp);
+	    if (r == NULL)
+	      r = cfunc_call (consts[ops[pc + 2]], n, v);
+	    while (sp > base)
+	      release (stack[--sp]);
+	    if (r == err_symbol)
+	      goto error;
+	    stack[sp++] = r;
+	    pc += 6 + n;
+	  }
+	  break;
+	case OP_BIND:
+	  binds[nbinds] = consts[ops[pc + 1]];
+	  sympush (binds[nbinds++], stack[--sp]);
+	  release (stack[sp]);
+	  pc += 2;
+	  break;
+	case OP_UNBIND:
+	  for (i = 0; i < ops[pc + 1]; i++)
+	    sympop (binds[--nbinds]);
+	  pc += 2;
+	  break;
+	case OP_CATCH:
+	  if (nhandlers == handlers_size)
+	    {
+	      handlers_size = handlers_size ? handlers_size * 2 : 4;
+	      handlers = xrealloc (handlers,
+				   handlers_size * sizeof (handler_t));
+	    }
+	  handlers[nhandlers].tag = stack[--sp];
+	  handlers[nhandlers].env = UPREF (env);
+	  handlers[nhandlers].sp = sp;
+	  handlers[nhandlers].nbinds = nbinds;
+	  handlers[nhandlers].target = ops[pc + 1];
+	  nhandlers++;
+	  pc += 2;
+	  break;
+	case OP_UNCATCH:
+	  nhandlers--;
+	  release (handlers[nhandlers].tag);
+	  release (handlers[nhandlers].env);
+	  pc++;
+	  break;
+	case OP_LOCAL:
+	  stack[sp++] = UPREF (locals[ops[pc + 1]]);
+	  pc += 2;
+	  break;
+	case OP_SETLOCAL:
+	  lex_store (&locals[ops[pc + 1]], stack[sp - 1]);
+	  pc += 2;
+	  break;
+	case OP_CLEAR:
+	  for (i = ops[pc + 1]; i < ops[pc + 1] + ops[pc + 2]; i++)
+	    {
+	      release (locals[i]);
+	      locals[i] = NIL;
+	    }
+	  pc += 3;
+	  break;
+	case OP_ENV:
+	  r = frame_out (env, ops[pc + 1]);
+	  stack[sp++] = UPREF (OVEC (r)->v[ops[pc + 2]]);
+	  pc += 3;
+	  break;
+	case OP_SETENV:
+	  r = frame_out (env, ops[pc + 1]);
+	  lex_store (&OVEC (r)->v[ops[pc + 2]], stack[sp - 1]);
+	  pc += 3;
+	  break;
+	case OP_FRAME:
+	  env = frame_enter (ops[pc + 1], env);
+	  pc += 2;
+	  break;
+	case OP_UNFRAME:
+	  r = env;
+	  env = UPREF (OVEC (r)->v[0]);
+	  release (r);
+	  pc++;
+	  break;
+	case OP_CLOSURE:
+	  stack[sp++] = c_closure (UPREF (consts[ops[pc + 1]]), UPREF (env));
+	  pc += 2;
+	  break;
+	case OP_RETURN:
+	  r = stack[--sp];
+	  goto done;
+	}
+    }
+
+error:
+  /* Resume at the innermost catch of the thrown tag, if any. */
+  while (nhandlers > 0)
+    {
+      handler_t *h = &handlers[--nhandlers];
+      if (h->tag == err_thrown)
+	{
+	  while (sp > h->sp)
+	    release (stack[--sp]);
+	  while (nbinds > h->nbinds)
+	    sympop (binds[--nbinds]);
+	  release (env);
+	  env = h->env;
+	  release (h->tag);
+	  obj_destroy (err_thrown);
+	  stack[sp++] = err_attach;
+	  pc = h->target;
+	  goto dispatch;
+	}
+      release (h->tag);
+      release (h->env);
+    }
+  while (sp > 0)
+    release (stack[--sp]);
+  while (nbinds > 0)
+    sympop (binds[--nbinds]);
+  r = err_symbol;
+done:
+  lex_release (c, locals, env);
+  xfree (handlers);
+  if (bound.v == NULL)
+    for (i = nbound (entry) - 1; i >= 0; i--)
+      sympop (entry->params[i]);
+  else
+    {
+      while (bound.n > 0)
+	sympop (bound.v[--bound.n]);
+      frame_free (&bound);
+    }
+  if (self != NULL)
+    release (self);
+  frame_free (&stk);
+  frame_free (&bnd);
+  frame_free (&loc);
+  return r;
+}
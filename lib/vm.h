@@ -0,0 +1,101 @@
+/* vm.h - bytecode compiler and virtual machine for lambda bodies */
+#ifndef VM_H
+#define VM_H
+
+#include "object.h"
+
+/* Instructions and their operands. Operands that refer to objects are
+ * indexes into the constant table; jump targets are op indexes. */
+typedef enum opcode
+{
+  OP_CONST,			/* k: push constant */
+  OP_VAR,			/* k: push value of symbol */
+  OP_SET,			/* k: store top in symbol, leave it there */
+  OP_POP,			/* discard top */
+  OP_JUMP,			/* t: jump */
+  OP_JNIL,			/* t: pop, jump if nil */
+  OP_JNIL_KEEP,			/* t: jump if top is nil, else pop */
+  OP_JTRUE_KEEP,		/* t: jump if top is non-nil, else pop */
+  OP_GUARD,			/* s v t: jump unless symbol s holds v */
+  OP_EVAL,			/* k n l...: push tree-walking eval of form */
+  OP_FUNC,			/* s t: push function in s, else jump */
+  OP_CALL,			/* n: call function below n arguments */
+  OP_TAILCALL,			/* n: call, reusing this frame if possible */
+  OP_PRIM,			/* n k p g t s...: call builtin k, number p */
+  OP_BIND,			/* k: pop and dynamically bind symbol */
+  OP_UNBIND,			/* n: undo the last n bindings */
+  OP_CATCH,			/* t: pop tag, jump to t when it is thrown */
+  OP_UNCATCH,			/* stop catching the last tag */
+  OP_LOCAL,			/* i: push local i */
+  OP_SETLOCAL,			/* i: store top in local i */
+  OP_CLEAR,			/* i n: set locals i to i + n - 1 to nil */
+  OP_ENV,			/* d i: push slot i of frame d out */
+  OP_SETENV,			/* d i: store top in slot i of frame d out */
+  OP_FRAME,			/* n: enter a new frame of n slots */
+  OP_UNFRAME,			/* return to the enclosing frame */
+  OP_CLOSURE,			/* k: push closure of function k */
+  OP_RETURN			/* return top */
+} opcode_t;
+
+/* Lexical variables are either locals, private to one activation, or
+ * slots of a heap frame when a closure captures them. OP_EVAL makes n
+ * of them visible to the tree walker by dynamically binding them for
+ * the evaluation. Each is described by three operands: the symbol's
+ * constant, then the depth and slot of OP_ENV, or LEX_LOCAL and the
+ * local. */
+#define LEX_LOCAL -1
+
+typedef struct code
+{
+  int *ops;			/* NULL if the body couldn't be compiled */
+  size_t nops;
+  object_t **consts;
+  size_t nconsts;
+  object_t **params;
+  int nreq, nopt, rest;		/* parameter counts, rest is 0 or 1 */
+  int maxstack, maxbinds;
+  int lexical;			/* closure body, params aren't bound */
+  int nlocals;
+  int *slots;			/* local of each param, or -frame slot */
+  int framesize;		/* params kept in a new frame */
+} code_t;
+
+/* Must be called after lisp_init() and before any code is loaded. */
+void vm_init ();
+
+/* Return compiled code for a lambda function or closure, compiling it
+ * on first use, or NULL if it must be run by the tree walker. */
+code_t *code_get (object_t * f);
+
+/* Most code that can exist at once; past this, lambdas aren't compiled. */
+#define CODE_MAX (1u << CODE_BITS)
+
+/* Called when an object with a code index is freed. */
+void code_forget (object_t * key);
+
+/* Run compiled code on an array of arguments. Lexical code runs in
+ * the environment frame env, which is nil for none. */
+object_t *vm_exec (code_t * c, object_t ** argv, int argc, object_t * env);
+
+/* Builtins called through OP_PRIM, in the order of prim_names in
+ * compile.c. The VM handles some argument types itself. */
+typedef enum prim
+{
+  PRIM_ADD, PRIM_SUB, PRIM_MUL, PRIM_DIV, PRIM_MOD,
+  PRIM_NUM_EQ, PRIM_LT, PRIM_LTE, PRIM_GT, PRIM_GTE,
+  PRIM_CAR, PRIM_CDR, PRIM_CONS, PRIM_EQ, PRIM_EQL, PRIM_NOT, PRIM_NULLP,
+  PRIM_LISTP, PRIM_SYMBOLP, PRIM_STRINGP, PRIM_NUMBERP, PRIM_INTEGERP,
+  PRIM_FLOATP, PRIM_VECTORP, PRIM_VGET, PRIM_VSET, PRIM_VLENGTH
+} prim_t;
+
+/* Most arguments a builtin may take to be called through OP_PRIM. */
+#define PRIM_MAX 3
+
+/* OP_PRIM jumps to t unless symbol g holds builtin k, when g isn't -1.
+ * Where each OP_PRIM argument comes from: */
+#define PRIM_STACK -1
+#define PRIM_CONST(k) ((k) * 2)
+#define PRIM_VAR(k) ((k) * 2 + 1)
+#define PRIM_LOCAL(i) (-2 - (i))	/* and the inverse */
+
+#endif /* VM_H */
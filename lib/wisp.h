@@ -14,5 +14,7 @@
 #include "reader.h"
 #include "number.h"
 #include "vector.h"
+#include "hashtable.h"
+#include "fasl.h"
 
 #endif /* LIST_H */
@@ -0,0 +1,80 @@
+/* hashtab_bench.c - measure hashtable insert and lookup throughput
+ *
+ * Usage: hashtab_bench [count]
+ *
+ * Keys are symbol-like strings, looked up once each as hits and once
+ * each as misses. */
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include "../lib/common.h"
+#include "../lib/hashtab.h"
+
+static double now ()
+{
+  struct timespec t;
+  clock_gettime (CLOCK_MONOTONIC, &t);
+  return t.tv_sec + t.tv_nsec / 1e9;
+}
+
+static void report (char *what, size_t n, double seconds)
+{
+  printf ("%-8s %10zu ops %8.3f s %8.2f Mops/s\n", what, n, seconds,
+	  n / seconds / 1e6);
+}
+
+int main (int argc, char **argv)
+{
+  size_t n = 1000000, i, found = 0;
+  if (argc > 1)
+    n = strtoul (argv[1], NULL, 10);
+
+  /* Build the keys up front so only the table is timed. */
+  char **keys = xmalloc (n * sizeof (char *));
+  char **misses = xmalloc (n * sizeof (char *));
+  for (i = 0; i < n; i++)
+    {
+      keys[i] = xmalloc (32);
+      misses[i] = xmalloc (32);
+      snprintf (keys[i], 32, "symbol-%zu", i);
+      snprintf (misses[i], 32, "missing-%zu", i);
+    }
+
+  /* Start small, the way the symbol table does, so growth is timed. */
+  hashtab_t *ht = ht_init (2048, NULL);
+  double t = now ();
+  for (i = 0; i < n; i++)
+    ht_insert (ht, keys[i], strlen (keys[i]), keys[i], 0);
+  report ("insert", n, now () - t);
+
+  t = now ();
+  for (i = 0; i < n; i++)
+    found += ht_search (ht, keys[i], strlen (keys[i])) == keys[i];
+  report ("hit", n, now () - t);
+
+  t = now ();
+  for (i = 0; i < n; i++)
+    found += ht_search (ht, misses[i], strlen (misses[i])) != NULL;
+  report ("miss", n, now () - t);
+
+  t = now ();
+  for (i = 0; i < n; i++)
+    ht_remove (ht, keys[i], strlen (keys[i]));
+  report ("remove", n, now () - t);
+
+  if (found != n || ht->count != 0)
+    {
+      fprintf (stderr, "error: table lost track of its keys\n");
+      return EXIT_FAILURE;
+    }
+  ht_destroy (ht);
+  for (i = 0; i < n; i++)
+    {
+      xfree (keys[i]);
+      xfree (misses[i]);
+    }
+  xfree (keys);
+  xfree (misses);
+  return EXIT_SUCCESS;
+}
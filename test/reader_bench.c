@@ -0,0 +1,108 @@
+/* reader_bench.c - measure reader throughput on a large input
+ *
+ * Usage: reader_bench [megabytes]
+ *
+ * Generates a file of data s-expressions (nested lists of symbols,
+ * numbers, strings and vectors) and times reading it back, then does
+ * the same for the binary encoding of the same records. */
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include "../lib/wisp.h"
+
+static double now ()
+{
+  struct timespec t;
+  clock_gettime (CLOCK_MONOTONIC, &t);
+  return t.tv_sec + t.tv_nsec / 1e9;
+}
+
+static void report (char *what, size_t count, size_t expect, size_t bytes,
+		    double seconds)
+{
+  if (count != expect)
+    {
+      fprintf (stderr, "error: read %zu of %zu records\n", count, expect);
+      exit (EXIT_FAILURE);
+    }
+  printf ("%-8s %zu records, %6.1f MB in %.3f s, %7.2f MB/s\n", what,
+	  count, bytes / 1048576.0, seconds, bytes / 1048576.0 / seconds);
+}
+
+/* Write one record, roughly 200 bytes. */
+static void write_record (FILE * f, size_t i)
+{
+  fprintf (f, "(record-%zu :id %zu :name \"entry number %zu\"\n", i % 997,
+	   i, i);
+  fprintf (f, "  :score %zu.%02zu :tags (alpha beta-%zu gamma)", i % 1000,
+	   i % 100, i % 13);
+  fprintf (f, " :data [%zu %zu %zu -%zu]\n", i * 7, i * 11, i % 5, i);
+  fprintf (f, "  (nested (list \"with \\\"escapes\\\"\" %zu)))"
+	   " ; comment\n", i * 3);
+}
+
+int main (int argc, char **argv)
+{
+  size_t mb = 16, i, bytes, count = 0;
+  if (argc > 1)
+    mb = strtoul (argv[1], NULL, 10);
+
+  wisp_init ();
+  FILE *f = tmpfile ();
+  if (f == NULL)
+    {
+      perror ("tmpfile");
+      return EXIT_FAILURE;
+    }
+  for (i = 0; (size_t) ftell (f) < mb * 1024 * 1024; i++)
+    write_record (f, i);
+  bytes = ftell (f);
+  rewind (f);
+
+  /* Text, writing each record back out in binary as well. */
+  FILE *bin = tmpfile ();
+  fasl_writer_t *w = fasl_writer_create (bin);
+  reader_t *r = reader_create (f, NULL, "bench", 0);
+  double t = now (), tw = 0;
+  while (!r->eof)
+    {
+      object_t *sexp = read_sexp (r);
+      if (sexp == err_symbol)
+	return EXIT_FAILURE;
+      if (sexp != NIL)
+	{
+	  double start = now ();
+	  fasl_write (w, sexp);
+	  tw += now () - start;
+	  count++;
+	}
+      obj_destroy (sexp);
+    }
+  t = now () - t - tw;
+  reader_destroy (r);
+  fasl_writer_destroy (w);
+  fclose (f);
+  report ("text", count, i, bytes, t);
+
+  bytes = ftell (bin);
+  rewind (bin);
+  count = 0;
+  fasl_reader_t *fr = fasl_reader_create (bin, NULL, 0, "bench");
+  t = now ();
+  while (1)
+    {
+      object_t *o = fasl_read (fr);
+      if (fr->eof)
+	break;
+      if (o == err_symbol)
+	return EXIT_FAILURE;
+      count++;
+      obj_destroy (o);
+    }
+  t = now () - t;
+  fasl_reader_destroy (fr);
+  fclose (bin);
+  report ("binary", count, i, bytes, t);
+  return EXIT_SUCCESS;
+}
@@ -4,6 +4,7 @@
 #include <unistd.h>
 #include <sys/wait.h>
 #include "../lib/wisp.h"
+#include "../lib/hashtab.h"
 
 /* Error testing */
 void assert (int b, char *msg);
@@ -12,6 +13,8 @@ int err_cnt = 0, test_cnt = 0;
 /* Tests */
 void symbol_tests ();
 void string_tests ();
+void hashtab_tests ();
+void fasl_tests ();
 void wisp_tests ();
 
 int main ()
@@ -22,6 +25,10 @@ int main ()
   symbol_tests ();
   printf ("Running string tests ...\n");
   string_tests ();
+  printf ("Running hashtable tests ...\n");
+  hashtab_tests ();
+  printf ("Running fasl tests ...\n");
+  fasl_tests ();
   printf ("Running Wisp code tests ...\n");
   wisp_tests ();
 
@@ -76,6 +83,100 @@ void symbol_tests ()
   assert (GET (so) == a, "symbol push/pop 3");
 }
 
+/* Hash everything to the same slot to exercise probing. */
+uint32_t bad_hash (void *key, size_t keylen)
+{
+  (void) key;
+  (void) keylen;
+  return 7;
+}
+
+void hashtab_tests ()
+{
+  static char keys[1000][8];
+  int i, ok = 1;
+  hashtab_t *ht = ht_init (1, NULL);
+  for (i = 0; i < 1000; i++)
+    {
+      sprintf (keys[i], "k%d", i);
+      ht_insert (ht, keys[i], strlen (keys[i]), keys[i], 0);
+    }
+  assert (ht->count == 1000 && ht->size * HT_LOAD >= 1000 * 8,
+	  "hashtable growth");
+  for (i = 0; i < 1000; i++)
+    ok &= ht_search (ht, keys[i], strlen (keys[i])) == keys[i];
+  assert (ok, "hashtable search");
+  ht_insert (ht, "k5", 2, "five", 0);
+  assert (strcmp (ht_search (ht, "k5", 2), "five") == 0 && ht->count == 1000,
+	  "hashtable replace");
+  for (i = 0; i < 1000; i += 2)
+    ht_remove (ht, keys[i], strlen (keys[i]));
+  for (i = 0, ok = 1; i < 1000; i++)
+    ok &= (ht_search (ht, keys[i], strlen (keys[i])) == NULL) == (i % 2 == 0);
+  assert (ok && ht->count == 500, "hashtable remove");
+  hashtab_iter_t ii;
+  for (i = 0, ht_iter_init (ht, &ii); ii.key != NULL; ht_iter_inc (&ii))
+    i++;
+  assert (i == 500, "hashtable iterate");
+  ht_destroy (ht);
+
+  ht = ht_init (16, &bad_hash);
+  for (i = 0; i < 12; i++)
+    ht_insert (ht, keys[i], strlen (keys[i]), keys[i], 0);
+  ht_remove (ht, keys[3], strlen (keys[3]));
+  for (i = 0, ok = 1; i < 12; i++)
+    ok &= (ht_search (ht, keys[i], strlen (keys[i])) == NULL) == (i == 3);
+  assert (ok, "hashtable custom hash");
+  ht_destroy (ht);
+}
+
+/* Return non-zero if decoding body after a fasl header throws
+ * fasl-error. */
+int bad_fasl (char *body, size_t len)
+{
+  char buf[64] = "WFASL\001";
+  buf[6] = sizeof (mp_limb_t);
+  memcpy (buf + 7, body, len);
+  fasl_reader_t *r = fasl_reader_create (NULL, buf, len + 7, "test");
+  object_t *o = fasl_read (r);
+  fasl_reader_destroy (r);
+  if (o != err_symbol)
+    {
+      obj_destroy (o);
+      return 0;
+    }
+  obj_destroy (err_attach);
+  return err_thrown == fasl_error;
+}
+
+void fasl_tests ()
+{
+  /* Counts far beyond the input must not be allocated. */
+  assert (bad_fasl ("\005\376\377\377\377\017", 6), "fasl bignum size");
+  assert (bad_fasl ("\007\377\377\377\377\017\002\000"
+		     "\001\000\000\000\000\000\000\000", 16),
+	  "fasl bigfloat precision");
+  assert (bad_fasl ("\007\200\004\376\377\377\377\017\000", 9),
+	  "fasl bigfloat size");
+  assert (bad_fasl ("\010\377\377\377\377\017", 6), "fasl string size");
+  assert (bad_fasl ("\001\377\377\377\377\017", 6), "fasl symbol size");
+  assert (bad_fasl ("\011\377\377\377\377\017", 6), "fasl list size");
+  assert (bad_fasl ("\012\377\377\377\377\017", 6), "fasl vector size");
+  assert (bad_fasl ("\013\000\377\377\377\377\017", 7),
+	  "fasl hash table size");
+
+  /* while a count the input can hold is fine */
+  char ok[] = "\010\003abc";
+  char buf[16] = "WFASL\001";
+  buf[6] = sizeof (mp_limb_t);
+  memcpy (buf + 7, ok, 5);
+  fasl_reader_t *r = fasl_reader_create (NULL, buf, 12, "test");
+  object_t *o = fasl_read (r);
+  assert (o != err_symbol && strcmp (OSTR (o), "abc") == 0, "fasl string");
+  obj_destroy (o);
+  fasl_reader_destroy (r);
+}
+
 int run_wisp_test (char *file)
 {
   /* fork() so that failures don't kill this process */
@@ -90,8 +191,49 @@ int run_wisp_test (char *file)
   return r == 0;
 }
 
+/* Run a test starting from a heap image rather than core.wisp. */
+int run_wisp_image_test (char *image, char *file)
+{
+  if (fork () == 0)
+    {
+      execl ("wisp", "wisp", "--image", image, file, NULL);
+      fprintf (stderr, "%s\n", strerror (errno));
+      exit (1);
+    }
+  int r;
+  wait (&r);
+  return r == 0;
+}
+
 void wisp_tests ()
 {
   assert (run_wisp_test ("test/stress.wisp"), "Wisp stress test");
   assert (run_wisp_test ("test/eq-test.wisp"), "Wisp equality");
+  assert (run_wisp_test ("test/cycle-test.wisp"), "Wisp cycle collection");
+  assert (run_wisp_test ("test/vm-test.wisp"), "Wisp bytecode compiler");
+  assert (run_wisp_test ("test/macro-test.wisp"), "Wisp macro expansion");
+  assert (run_wisp_test ("test/hashtable-test.wisp"), "Wisp hash tables");
+  assert (run_wisp_test ("test/closure-test.wisp"), "Wisp closures");
+  assert (run_wisp_test ("test/fasl-test.wisp"), "Wisp binary encoding");
+  assert (run_wisp_test ("test/print-test.wisp"), "Wisp printer");
+  assert (run_wisp_test ("test/port-test.wisp"), "Wisp file ports");
+  assert (run_wisp_test ("test/detach-test.wisp"), "Wisp detachments");
+
+  char image[] = "/tmp/wisp-image-XXXXXX";
+  int fd = mkstemp (image);
+  close (fd);
+  if (fork () == 0)
+    {
+      execl ("wisp", "wisp", "--dump-image", image, "test/image-setup.wisp",
+	     NULL);
+      exit (1);
+    }
+  int r;
+  wait (&r);
+  assert (r == 0, "Wisp heap image dump");
+  assert (run_wisp_image_test (image, "test/eq-test.wisp"),
+	  "Wisp heap image");
+  assert (run_wisp_image_test (image, "test/image-test.wisp"),
+	  "Wisp heap image identity");
+  unlink (image);
 }
@@ -10,6 +10,13 @@ char *version = "alpha";
 char *progname;
 int force_interaction = 0;
 int print_help = 0;
+char *dump_file = NULL;
+
+struct option long_options[] = {
+  {"image", required_argument, NULL, 'I'},
+  {"dump-image", required_argument, NULL, 'D'},
+  {NULL, 0, NULL, 0}
+};
 
 void print_usage (int ret)
 {
@@ -17,6 +24,9 @@ void print_usage (int ret)
   printf ("\t-i           Force interaction mode\n");
   printf ("\t-v           Print version information\n");
   printf ("\t-h           Print this usage text\n");
+  printf ("\t--image file        Start from a heap image\n");
+  printf ("\t--dump-image file   Load the program, if any, then save a "
+	  "heap image\n");
   exit (ret);
 }
 
@@ -28,13 +38,18 @@ void print_version ()
 int main (int argc, char **argv)
 {
   progname = argv[0];
-  wisp_init ();
 
   /* parse arguments */
   int c;
-  while ((c = getopt (argc, argv, "+ihv")) != -1)
+  while ((c = getopt_long (argc, argv, "+ihv", long_options, NULL)) != -1)
     switch (c)
       {
+      case 'I':
+	core_image = optarg;
+	break;
+      case 'D':
+	dump_file = optarg;
+	break;
       case 'i':
 	force_interaction = 1;
 	break;
@@ -50,6 +65,24 @@ int main (int argc, char **argv)
       }
   if (print_help)
     print_usage (EXIT_SUCCESS);
+  wisp_init ();
+
+  if (dump_file != NULL)
+    {
+      if (argc - optind >= 1 && !load_file (NULL, argv[optind], 0))
+	{
+	  fprintf (stderr, "error: could not load %s: %s\n",
+		   argv[optind], strerror (errno));
+	  exit (EXIT_FAILURE);
+	}
+      if (!dump_image (dump_file))
+	{
+	  fprintf (stderr, "error: could not write image %s: %s\n",
+		   dump_file, strerror (errno));
+	  exit (EXIT_FAILURE);
+	}
+      return EXIT_SUCCESS;
+    }
 
   if (argc - optind < 1)
     {